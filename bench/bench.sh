@@ -0,0 +1,95 @@
+#!/bin/sh
+# bench.sh: time every tool end to end on a corpus of synthetic roms
+# usage: bench.sh [mdbench] [results]
+#
+# Roms of each size in $SIZES megabits (default 1 8 64) are generated
+# by mdbench, with random and with low-entropy payloads, as BIN and as
+# SMD, so that every machine times the same bytes.  Each tool is then
+# run on each rom, and the best of $RUNS runs (default 5) is kept.
+#
+# A table goes to standard output, and the same results to the file
+# `results' (default results.csv) as CSV with the columns
+#   revision,tool,case,format,payload,mbits,bytes,seconds,mb_per_s,syscalls
+# one line per run, always in the same order, so that the files of two
+# versions can be compared line by line.  MB/s is of the input rom;
+# syscalls is -1 where they cannot be counted.
+#
+# The tools are looked for where their Makefiles build them; set
+# MDCHKSUM, MBITPAD, BIN2SMD, SMD2BIN, BIN2HILO or S128K to use others.
+# Every tool must have been built, so that every run has the same rows.
+
+MDBENCH=${1:-./mdbench}
+RESULTS=${2:-results.csv}
+SIZES=${SIZES:-1 8 64}
+RUNS=${RUNS:-5}
+HERE=$(cd "$(dirname "$0")" && pwd)
+MDCHKSUM=${MDCHKSUM:-${HERE}/../mdchksum/mdchksum}
+MBITPAD=${MBITPAD:-${HERE}/../mbitpad/mbitpad}
+BIN2SMD=${BIN2SMD:-${HERE}/../mdconvert/bin2smd/bin2smd}
+SMD2BIN=${SMD2BIN:-${HERE}/../mdconvert/smd2bin/smd2bin}
+BIN2HILO=${BIN2HILO:-${HERE}/../mdconvert/bin2hilo/bin2hilo}
+S128K=${S128K:-${HERE}/../mdconvert/s128k/s128k}
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/mdbench.XXXXXX") || exit 1
+trap 'rm -rf "${WORK}"' EXIT INT TERM
+
+REVISION=$(git -C "${HERE}" describe --always --dirty 2>/dev/null \
+           || echo unknown)
+
+for tool in "${MDCHKSUM}" "${MBITPAD}" "${BIN2SMD}" "${SMD2BIN}" \
+            "${BIN2HILO}" "${S128K}"; do
+	if [ ! -x "${tool}" ]; then
+		echo "bench.sh: ${tool} has not been built" >&2
+		exit 1
+	fi
+done
+
+# bench tool case format payload mbits infile [mdbench run options] command
+bench() {
+	tool=$1 name=$2 format=$3 payload=$4 mbits=$5 rom=$6
+	shift 6
+	bytes=$(wc -c <"${rom}" | tr -d ' ')
+	set -- $("${MDBENCH}" run -n "${RUNS}" "$@") || exit 1
+	[ $# -eq 2 ] || exit 1
+	echo "${REVISION} ${tool} ${name} ${format} ${payload} ${mbits} ${bytes} $1 $2" \
+	| awk '{ printf "%s,%s,%s,%s,%s,%d,%d,%.6f,%.1f,%d\n",
+	                $1, $2, $3, $4, $5, $6, $7, $8, $7 / $8 / 1e6, $9 }' \
+	>>"${RESULTS}"
+	printf '%-10s %-10s %-4s %-7s %6d %10.4f %10.1f %9d\n' \
+	       "${tool}" "${name}" "${format}" "${payload}" "${mbits}" "$1" \
+	       "$(echo "${bytes} $1" | awk '{ print $1 / $2 / 1e6 }')" "$2"
+}
+
+echo revision,tool,case,format,payload,mbits,bytes,seconds,mb_per_s,syscalls \
+	>"${RESULTS}" || exit 1
+printf '%-10s %-10s %-4s %-7s %6s %10s %10s %9s\n' \
+       tool case fmt payload Mbit seconds 'MB/s' syscalls
+for payload in random low; do
+	for mbits in ${SIZES}; do
+		BIN=${WORK}/${payload}${mbits}.bin
+		SMD=${WORK}/${payload}${mbits}.smd
+		"${MDBENCH}" gen -p "${payload}" "${mbits}" "${BIN}" || exit 1
+		"${MDBENCH}" gen -f smd -p "${payload}" "${mbits}" "${SMD}" || exit 1
+
+		bench mdchksum calc bin "${payload}" "${mbits}" "${BIN}" \
+		      "${MDCHKSUM}" "${BIN}"
+		bench mbitpad double bin "${payload}" "${mbits}" "${BIN}" \
+		      -i "${BIN}" -o "${WORK}/out" \
+		      "${MBITPAD}" -s "$((2 * mbits))" -
+		bench mbitpad fix bin "${payload}" "${mbits}" "${BIN}" \
+		      -i "${BIN}" -o "${WORK}/out" \
+		      "${MBITPAD}" -f -s "$((2 * mbits))" -
+		bench bin2smd convert bin "${payload}" "${mbits}" "${BIN}" \
+		      "${BIN2SMD}" -o "${WORK}/out" "${BIN}"
+		bench smd2bin convert smd "${payload}" "${mbits}" "${SMD}" \
+		      "${SMD2BIN}" -o "${WORK}/out" "${SMD}"
+		bench bin2hilo split bin "${payload}" "${mbits}" "${BIN}" \
+		      "${BIN2HILO}" "${BIN}" "${WORK}/hi" "${WORK}/lo"
+		# s128k writes its pieces next to its input
+		cp "${BIN}" "${WORK}/split.bin"
+		bench s128k split bin "${payload}" "${mbits}" "${BIN}" \
+		      "${S128K}" "${WORK}/split.bin"
+		rm -f "${WORK}"/out "${WORK}"/hi "${WORK}"/lo "${WORK}"/split.bin* \
+		      "${BIN}" "${SMD}"
+	done
+done
+echo "results written to ${RESULTS}"
@@ -0,0 +1,452 @@
+/*****************************************************************************
+ * kernbench: time each librom kernel, at each kernel level, in memory
+ * The checksum, the SMD block (de)interleave of bin2smd and smd2bin, the
+ * even/odd split of bin2hilo and hilo2bin, and the bank splits of s128k
+ * and romsplit are run on buffers already in memory, so that no file
+ * system or page cache time is counted.  Each is timed at every level the
+ * CPU supports (see kernel.h), and its output is checked against the
+ * scalar version's.
+ * See the function ``print_license'' below for license information.
+ ****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_TSC 1
+#include <x86intrin.h>
+#endif
+
+#include "checksum.h"
+#include "kernel.h"
+#include "smd.h"
+#include "split.h"
+
+#define DEFAULT_KILOBYTES 1024
+#define DEFAULT_SAMPLES 11
+/* each sample runs long enough for the clock to be well resolved */
+#define SAMPLE_SECONDS 0.01
+#define MAX_PIECES 64
+#define PERR(str) fprintf(stderr, str)
+
+struct bench
+{
+	char const *name;
+	/* run the kernel once over `size' bytes */
+	void (*run)(struct bench*);
+	/* lanes and bank size of a split, or 0 */
+	unsigned lanes;
+	size_t bank_size;
+	size_t size;
+	unsigned char *in;
+	unsigned char *out;
+	unsigned char *pieces[MAX_PIECES];
+	unsigned int sum;
+};
+
+struct sample
+{
+	double seconds;
+	double ticks;
+};
+
+void run_checksum(struct bench*);
+void run_smd_encode(struct bench*);
+void run_smd_decode(struct bench*);
+void run_split(struct bench*);
+void run_join(struct bench*);
+void measure(struct bench*, int, struct sample*);
+unsigned char *result(struct bench*, size_t*);
+double now(void);
+double ticks(void);
+int compare_doubles(void const*, void const*);
+void print_help();
+void print_license();
+
+int
+main(int argc, char* argv[])
+{
+	struct bench benches[] = {
+		{"checksum", run_checksum, 0, 0, 0, NULL, NULL, {NULL}, 0},
+		{"smd-encode", run_smd_encode, 0, 0, 0, NULL, NULL, {NULL}, 0},
+		{"smd-decode", run_smd_decode, 0, 0, 0, NULL, NULL, {NULL}, 0},
+		{"hilo-split", run_split, 2, 0, 0, NULL, NULL, {NULL}, 0},
+		{"hilo-join", run_join, 2, 0, 0, NULL, NULL, {NULL}, 0},
+		{"s128k-split", run_split, 2, 0x20000, 0, NULL, NULL, {NULL}, 0},
+		{"s128k-join", run_join, 2, 0x20000, 0, NULL, NULL, {NULL}, 0},
+		{"split4-512k", run_split, 4, 0x80000, 0, NULL, NULL, {NULL}, 0},
+		{"join4-512k", run_join, 4, 0x80000, 0, NULL, NULL, {NULL}, 0}
+	};
+	size_t const nbenches = sizeof(benches) / sizeof(benches[0]);
+	struct sample samples[2 * DEFAULT_SAMPLES + 1];
+	double cycles[2 * DEFAULT_SAMPLES + 1];
+	int ch = 0, cflag = 0, hflag = 0, lflag = 0;
+	int nsamples = DEFAULT_SAMPLES;
+	unsigned long kilobytes = DEFAULT_KILOBYTES;
+	unsigned char *reference = NULL, *got;
+	size_t size, length, i;
+	unsigned long npieces, p;
+	int level, best, s;
+	double median, low, spread;
+	char *end;
+
+	while ( (ch = getopt(argc, argv, "ch?ln:s:")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'c':
+			cflag = 1;
+			break;
+		case 'l':
+			lflag = 1;
+			break;
+		case 'n':
+			nsamples = strtol(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || nsamples < 1
+			    || nsamples > 2 * DEFAULT_SAMPLES + 1)
+			{
+				errx(EXIT_FAILURE, "Sample count must be 1 to %d",
+				     2 * DEFAULT_SAMPLES + 1);
+			}
+			break;
+		case 's':
+			kilobytes = strtoul(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || kilobytes < 1
+			    || kilobytes > 1024 * 1024)
+			{
+				errx(EXIT_FAILURE, "Invalid size %s", optarg);
+			}
+			break;
+		default:
+			hflag = 1;
+			break;
+		}
+	}
+	if (lflag)
+	{
+		print_license();
+		return EXIT_SUCCESS;
+	}
+	if (hflag || optind != argc)
+	{
+		print_help();
+		return hflag ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	size = kilobytes * 1024;
+	best = rom_kernel_best();
+	if (cflag)
+	{
+		puts("kernel,level,bytes,cycles_per_byte,min_cycles_per_byte,"
+		     "gb_per_s,spread");
+	}
+	else
+	{
+#ifdef HAVE_TSC
+		printf("%lu kB buffers, median of %d samples; "
+		       "cycles are TSC ticks\n", kilobytes, nsamples);
+#else
+		printf("%lu kB buffers, median of %d samples; "
+		       "no cycle counter, so cycles are nanoseconds\n",
+		       kilobytes, nsamples);
+#endif
+		printf("%-12s %-7s %10s %10s %8s %7s\n",
+		       "kernel", "level", "cyc/B", "min cyc/B", "GB/s", "spread");
+	}
+
+	for (i = 0; i < nbenches; ++i)
+	{
+		struct bench *b = &benches[i];
+
+		b->size = size;
+		b->in = malloc(size + ROM_SMD_HEADER_SIZE);
+		b->out = malloc(size + ROM_SMD_HEADER_SIZE);
+		npieces = b->lanes ? rom_split_pieces(size, b->lanes, b->bank_size)
+			: 0;
+		if (b->in == NULL || b->out == NULL || npieces > MAX_PIECES)
+		{
+			errx(EXIT_FAILURE, "Could not set up %s at %lu kB",
+			     b->name, kilobytes);
+		}
+		for (p = 0; p < npieces; ++p)
+		{
+			b->pieces[p] = malloc(rom_piece_size(size, b->lanes,
+			                                     b->bank_size, p));
+			if (b->pieces[p] == NULL)
+			{
+				err(EXIT_FAILURE, "Could not set up %s", b->name);
+			}
+		}
+		srand(1);
+		for (length = 0; length < size + ROM_SMD_HEADER_SIZE; ++length)
+		{
+			b->in[length] = rand() & 0xff;
+		}
+		if (b->run == run_join)
+		{
+			/* the pieces to join are those of the input */
+			rom_split_buffer(b->pieces, b->in, size, b->lanes,
+			                 b->bank_size);
+		}
+
+		for (level = ROM_KERNEL_SCALAR; level <= best; ++level)
+		{
+			rom_kernel_limit(level);
+			measure(b, nsamples, samples);
+
+			got = result(b, &length);
+			if (level == ROM_KERNEL_SCALAR)
+			{
+				free(reference);
+				reference = malloc(length);
+				if (reference == NULL)
+				{
+					err(EXIT_FAILURE, "Could not check %s", b->name);
+				}
+				memcpy(reference, got, length);
+			}
+			else if (memcmp(reference, got, length) != 0)
+			{
+				warnx("%s: %s does not match scalar", b->name,
+				      rom_kernel_name(level));
+			}
+			free(got);
+
+			for (s = 0; s < nsamples; ++s)
+			{
+				cycles[s] = samples[s].ticks / size;
+			}
+			qsort(cycles, nsamples, sizeof(*cycles), compare_doubles);
+			median = cycles[nsamples / 2];
+			low = cycles[0];
+			/* interquartile range, relative to the median */
+			spread = (cycles[(3 * nsamples) / 4] - cycles[nsamples / 4])
+				/ median;
+			for (s = 0; s < nsamples; ++s)
+			{
+				cycles[s] = samples[s].seconds;
+			}
+			qsort(cycles, nsamples, sizeof(*cycles), compare_doubles);
+			if (cflag)
+			{
+				printf("%s,%s,%lu,%.4f,%.4f,%.3f,%.4f\n", b->name,
+				       rom_kernel_name(level), (unsigned long)size,
+				       median, low, size / cycles[nsamples / 2] / 1e9,
+				       spread);
+			}
+			else
+			{
+				printf("%-12s %-7s %10.4f %10.4f %8.2f %6.1f%%\n", b->name,
+				       rom_kernel_name(level), median, low,
+				       size / cycles[nsamples / 2] / 1e9, 100 * spread);
+			}
+		}
+		rom_kernel_limit(best);
+
+		for (p = 0; p < npieces; ++p)
+		{
+			free(b->pieces[p]);
+		}
+		free(b->in);
+		free(b->out);
+	}
+	free(reference);
+	return EXIT_SUCCESS;
+}
+
+
+void
+run_checksum(struct bench *b)
+{
+	/* the sum is kept so that the call cannot be optimized away */
+	b->sum += rom_calculate_checksum(b->in, b->size + ROM_DATA_START);
+}
+
+void
+run_smd_encode(struct bench *b)
+{
+	rom_smd_encode(b->out, b->in, b->size);
+}
+
+void
+run_smd_decode(struct bench *b)
+{
+	rom_smd_decode(b->out, b->in, b->size);
+}
+
+void
+run_split(struct bench *b)
+{
+	rom_split_buffer(b->pieces, b->in, b->size, b->lanes, b->bank_size);
+}
+
+void
+run_join(struct bench *b)
+{
+	rom_join_buffer(b->out, (unsigned char const * const *)b->pieces,
+	                b->size, b->lanes, b->bank_size);
+}
+
+/* Find how many runs fill SAMPLE_SECONDS, then time `nsamples' samples
+ * of that many runs, giving each as the time of one run.
+ */
+void
+measure(struct bench *b, int nsamples, struct sample *samples)
+{
+	unsigned long reps = 1, r;
+	double t0, c0;
+	int s;
+
+	/* warm the caches, and find the number of runs */
+	for (;;)
+	{
+		t0 = now();
+		for (r = 0; r < reps; ++r)
+		{
+			b->run(b);
+		}
+		if (now() - t0 >= SAMPLE_SECONDS || reps >= (1UL << 30))
+		{
+			break;
+		}
+		reps *= 2;
+	}
+	for (s = 0; s < nsamples; ++s)
+	{
+		t0 = now();
+		c0 = ticks();
+		for (r = 0; r < reps; ++r)
+		{
+			b->run(b);
+		}
+		samples[s].ticks = (ticks() - c0) / reps;
+		samples[s].seconds = (now() - t0) / reps;
+	}
+}
+
+/* What the kernel produced, in a new buffer of `*length' bytes */
+unsigned char *
+result(struct bench *b, size_t *length)
+{
+	unsigned char *copy;
+	unsigned long npieces, p;
+	size_t at = 0, n;
+
+	b->sum = 0;
+	b->run(b);
+	*length = (b->run == run_checksum) ? sizeof(b->sum) : b->size;
+	copy = malloc(*length);
+	if (copy == NULL)
+	{
+		err(EXIT_FAILURE, "Could not check %s", b->name);
+	}
+	if (b->run == run_checksum)
+	{
+		memcpy(copy, &b->sum, sizeof(b->sum));
+	}
+	else if (b->run == run_split)
+	{
+		npieces = rom_split_pieces(b->size, b->lanes, b->bank_size);
+		for (p = 0; p < npieces; ++p)
+		{
+			n = rom_piece_size(b->size, b->lanes, b->bank_size, p);
+			memcpy(copy + at, b->pieces[p], n);
+			at += n;
+		}
+	}
+	else
+	{
+		memcpy(copy, b->out, b->size);
+	}
+	return copy;
+}
+
+double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The cycle counter, or nanoseconds where there is none */
+double
+ticks(void)
+{
+#ifdef HAVE_TSC
+	return (double)__rdtsc();
+#else
+	return now() * 1e9;
+#endif
+}
+
+int
+compare_doubles(void const *a, void const *b)
+{
+	double const x = *(double const *)a, y = *(double const *)b;
+
+	return (x > y) - (x < y);
+}
+
+
+void
+print_help()
+{
+	PERR("kernbench Copyright (c) 2026, Dakotah Lambert.\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: kernbench [-ch?l] [-n samples] [-s kilobytes]\n\n");
+	PERR("  -h, -? : show this message\n");
+	PERR("  -l     : display license information\n");
+	PERR("  -c     : print CSV rather than a table\n");
+	PERR("  -n     : samples per kernel and level (default 11);\n");
+	PERR("           the median is reported\n");
+	PERR("  -s     : size of the buffers in kB (default 1024)\n\n");
+	PERR("Each kernel is timed at each kernel level the CPU supports,\n");
+	PERR("in cycles per byte of rom, and checked against the scalar one.\n");
+	PERR("A kernel with no version for a level runs its best one below.\n");
+	PERR("spread is the interquartile range of the samples,\n");
+	PERR("relative to the median.\n\n");
+}
+
+void
+print_license()
+{
+	PERR("\n kernbench\n\
+ Copyright (c) 2026, Dakotah Lambert\n\
+ All rights reserved.\n\
+\n\
+ Redistribution and use in source and binary forms, with or without\n\
+ modification, are permitted provided that the following conditions\n\
+ are met:\n\
+\n\
+ 1: Redistributions of source code must retain the above copyright\n\
+    notice, this list of conditions and the following disclaimer.\n\
+\n\
+ 2: Redistributions in binary form must reproduce the above copyright\n\
+    notice, this list of conditions and the following disclaimer in\n\
+    the documentation and/or other materials provided with the\n\
+    distribution.\n\
+\n\
+ 3: Neither the names of copyright holders nor the names of their\n\
+    contributors may be used to endors or promote products derived\n\
+    from this software without specific prior written permission.\n\
+\n\
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS\n\
+  \"AS IS\" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT\n\
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS\n\
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED, IN NO EVENT SHALL THE\n\
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,\n\
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,\n\
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;\n\
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER\n\
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT\n\
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN\n\
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE\n\
+  POSSIBILITY OF SUCH DAMAGE.\n\n");
+}
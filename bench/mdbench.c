@@ -0,0 +1,507 @@
+/*****************************************************************************
+ * mdbench: make synthetic roms, and time the tools on them
+ *   mdbench gen [-f bin|smd] [-p random|low] [-s seed] megabits outfile
+ * writes a rom with a valid header and checksum whose payload depends
+ * only on its arguments, so that every machine benchmarks the same bytes.
+ *   mdbench run [-n runs] [-i infile] [-o outfile] command [arg ...]
+ * runs the command `runs' times and prints the best wall-clock time in
+ * seconds and the number of system calls one run made.
+ * See the function ``print_license'' below for license information.
+ ****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ptrace.h>
+#endif
+
+#include "checksum.h"
+#include "pad.h"
+#include "smd.h"
+
+#define FORMAT_BIN 0
+#define FORMAT_SMD 1
+#define PAYLOAD_RANDOM 0
+#define PAYLOAD_LOW 1
+#define DEFAULT_SEED 1
+#define DEFAULT_RUNS 5
+#define LOW_TILE 0x1000
+#define PERR(str) fprintf(stderr, str)
+
+int gen(int, char**);
+void fill_header(unsigned char*, size_t);
+void fill_payload(unsigned char*, size_t, int, uint64_t);
+uint64_t next_random(uint64_t*);
+int run(int, char**);
+pid_t start(char**, char const*, char const*, int);
+double now(void);
+long count_syscalls(char**, char const*, char const*);
+void print_help();
+void print_license();
+
+int
+main(int argc, char* argv[])
+{
+	if (argc >= 2 && strcmp(argv[1], "gen") == 0)
+	{
+		return gen(argc - 1, argv + 1);
+	}
+	if (argc >= 2 && strcmp(argv[1], "run") == 0)
+	{
+		return run(argc - 1, argv + 1);
+	}
+	if (argc >= 2 && strcmp(argv[1], "-l") == 0)
+	{
+		print_license();
+		return EXIT_SUCCESS;
+	}
+	print_help();
+	return EXIT_FAILURE;
+}
+
+
+int
+gen(int argc, char* argv[])
+{
+	int ch = 0, format = FORMAT_BIN, payload = PAYLOAD_RANDOM;
+	uint64_t seed = DEFAULT_SEED;
+	unsigned long mbits;
+	unsigned char *rom, *smd = NULL;
+	size_t size;
+	char *end;
+	FILE *out;
+	int status;
+
+	while ( (ch = getopt(argc, argv, "f:p:s:")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'f':
+			if (strcasecmp(optarg, "bin") == 0)
+			{
+				format = FORMAT_BIN;
+			}
+			else if (strcasecmp(optarg, "smd") == 0)
+			{
+				format = FORMAT_SMD;
+			}
+			else
+			{
+				errx(EXIT_FAILURE, "Unknown rom type %s", optarg);
+			}
+			break;
+		case 'p':
+			if (strcmp(optarg, "random") == 0)
+			{
+				payload = PAYLOAD_RANDOM;
+			}
+			else if (strcmp(optarg, "low") == 0)
+			{
+				payload = PAYLOAD_LOW;
+			}
+			else
+			{
+				errx(EXIT_FAILURE, "Unknown payload %s", optarg);
+			}
+			break;
+		case 's':
+			seed = strtoull(optarg, &end, 0);
+			if (end == optarg || *end != '\0')
+			{
+				errx(EXIT_FAILURE, "Invalid seed %s", optarg);
+			}
+			break;
+		default:
+			print_help();
+			return EXIT_FAILURE;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+	{
+		print_help();
+		return EXIT_FAILURE;
+	}
+	mbits = strtoul(argv[0], &end, 10);
+	if (end == argv[0] || *end != '\0' || mbits < 1 || mbits > 4096)
+	{
+		errx(EXIT_FAILURE, "Invalid size %s", argv[0]);
+	}
+
+	size = mbits * ROM_MBIT;
+	rom = malloc(size);
+	if (rom == NULL)
+	{
+		err(EXIT_FAILURE, "Could not make a rom of %lu Mbit", mbits);
+	}
+	/* the seed is mixed with the size, so that sizes differ throughout */
+	fill_payload(rom, size, payload, seed ^ ((uint64_t)mbits << 32));
+	fill_header(rom, size);
+	rom_fix_checksum(rom, size, rom_calculate_checksum(rom, size));
+	if (format == FORMAT_SMD)
+	{
+		smd = malloc(ROM_SMD_HEADER_SIZE + rom_smd_size(size));
+		if (smd == NULL)
+		{
+			err(EXIT_FAILURE, "Could not make a rom of %lu Mbit", mbits);
+		}
+		rom_smd_header(smd, size);
+		rom_smd_encode(smd + ROM_SMD_HEADER_SIZE, rom, size);
+	}
+
+	out = (strcmp(argv[1], "-") == 0) ? stdout : fopen(argv[1], "wb");
+	if (out == NULL)
+	{
+		err(EXIT_FAILURE, "Could not open file %s", argv[1]);
+	}
+	if (smd != NULL)
+	{
+		status = fwrite(smd, 1, ROM_SMD_HEADER_SIZE + rom_smd_size(size), out)
+			== ROM_SMD_HEADER_SIZE + rom_smd_size(size);
+	}
+	else
+	{
+		status = fwrite(rom, 1, size, out) == size;
+	}
+	if (!status || fclose(out) != 0)
+	{
+		err(EXIT_FAILURE, "Could not write %s", argv[1]);
+	}
+	free(rom);
+	free(smd);
+	return EXIT_SUCCESS;
+}
+
+/* A plausible header: vectors, the "SEGA" signature, names, and a size
+ * field holding the size of the rom, as the tools read it.
+ */
+void
+fill_header(unsigned char *rom, size_t size)
+{
+	static char const text[] =
+		"SEGA MEGA DRIVE (C)MDBN 2026.JAN"
+		"MDBENCH SYNTHETIC ROM                           "
+		"MDBENCH SYNTHETIC ROM                           "
+		"GM 00000000-00";
+	int i;
+
+	/* stack pointer and entry point */
+	memcpy(rom, "\x00\xff\xfe\x00\x00\x00\x02\x00", 8);
+	memcpy(rom + 0x100, text, sizeof(text) - 1);
+	memcpy(rom + 0x190, "J               ", 16);
+	memset(rom + 0x1a0, 0, 4);
+	for (i = 0; i < 4; ++i)
+	{
+		rom[ROM_SIZE_LOCATION + i] = (size >> (24 - 8 * i)) & 0xff;
+	}
+	memcpy(rom + 0x1a8, "\x00\xff\x00\x00\x00\xff\xff\xff", 8);
+	memset(rom + 0x1b0, ' ', 0x50);
+	memcpy(rom + 0x1f0, "JUE", 3);
+}
+
+/* Random bytes, or a low-entropy image: mostly erased (0xFF) space,
+ * with a few tiles of repeated code-like bytes, as a small game padded
+ * out to a large chip would be.
+ */
+void
+fill_payload(unsigned char *rom, size_t size, int payload, uint64_t seed)
+{
+	uint64_t state = seed ? seed : DEFAULT_SEED;
+	uint64_t r;
+	size_t i, j;
+
+	if (payload == PAYLOAD_RANDOM)
+	{
+		for (i = 0; i < size; i += 8)
+		{
+			r = next_random(&state);
+			for (j = 0; j < 8 && i + j < size; ++j)
+			{
+				rom[i + j] = (r >> (8 * j)) & 0xff;
+			}
+		}
+		return;
+	}
+	rom_pad(rom, 0, size, 0xff);
+	for (i = 0; i < size; i += LOW_TILE)
+	{
+		if (next_random(&state) % 4 != 0)
+		{
+			continue;
+		}
+		r = next_random(&state);
+		for (j = 0; j < LOW_TILE && i + j < size; ++j)
+		{
+			rom[i + j] = ((r >> (8 * (j % 8))) + j / 16) & 0xff;
+		}
+	}
+}
+
+/* xorshift64* */
+uint64_t
+next_random(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * UINT64_C(2685821657736338717);
+}
+
+
+int
+run(int argc, char* argv[])
+{
+	int ch = 0;
+	long runs = DEFAULT_RUNS;
+	char const *in = NULL, *out = NULL;
+	char *end;
+	double best = -1, t;
+	long syscalls;
+	pid_t pid;
+	int status;
+	long i;
+
+	/* the command's own options are not ours */
+	while ( (ch = getopt(argc, argv, "+i:n:o:")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'i':
+			in = optarg;
+			break;
+		case 'n':
+			runs = strtol(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || runs < 1)
+			{
+				errx(EXIT_FAILURE, "Invalid run count %s", optarg);
+			}
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		default:
+			print_help();
+			return EXIT_FAILURE;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc < 1)
+	{
+		print_help();
+		return EXIT_FAILURE;
+	}
+
+	/* the traced run also warms the page cache for the timed ones */
+	syscalls = count_syscalls(argv, in, out);
+	for (i = 0; i < runs; ++i)
+	{
+		t = now();
+		pid = start(argv, in, out, 0);
+		if (pid == -1 || waitpid(pid, &status, 0) == -1)
+		{
+			err(EXIT_FAILURE, "Could not run %s", argv[0]);
+		}
+		t = now() - t;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			errx(EXIT_FAILURE, "%s failed", argv[0]);
+		}
+		if (best < 0 || t < best)
+		{
+			best = t;
+		}
+	}
+	printf("%.6f %ld\n", best, syscalls);
+	return EXIT_SUCCESS;
+}
+
+/* Start `argv' with its standard input and output redirected from and
+ * to `in' and `out' (or /dev/null), traced if `trace' is set.
+ * Returns its pid, or -1 with errno set.
+ */
+pid_t
+start(char **argv, char const *in, char const *out, int trace)
+{
+	pid_t pid = fork();
+	int fd;
+
+	if (pid != 0)
+	{
+		return pid;
+	}
+	fd = open((in != NULL) ? in : "/dev/null", O_RDONLY);
+	if (fd == -1 || dup2(fd, STDIN_FILENO) == -1)
+	{
+		_exit(127);
+	}
+	close(fd);
+	fd = (out != NULL) ? open(out, O_RDWR | O_CREAT | O_TRUNC, 0666)
+		: open("/dev/null", O_WRONLY);
+	if (fd == -1 || dup2(fd, STDOUT_FILENO) == -1)
+	{
+		_exit(127);
+	}
+	close(fd);
+#ifdef __linux__
+	if (trace && ptrace(PTRACE_TRACEME, 0, NULL, NULL) == -1)
+	{
+		_exit(127);
+	}
+#else
+	(void)trace;
+#endif
+	execvp(argv[0], argv);
+	_exit(127);
+}
+
+double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run `argv' once under ptrace, following its threads, and count the
+ * system calls it enters.  A system call stop comes once on the way in
+ * and once on the way out, except for the calls that end a thread.
+ * Returns the count, or -1 where it cannot be had.
+ */
+long
+count_syscalls(char **argv, char const *in, char const *out)
+{
+#ifdef __linux__
+	long stops = 0, ends = 0;
+	pid_t pid, tid;
+	int status, sig;
+
+	pid = start(argv, in, out, 1);
+	if (pid == -1)
+	{
+		return -1;
+	}
+	/* stopped at the exec */
+	if (waitpid(pid, &status, 0) == -1 || !WIFSTOPPED(status))
+	{
+		return -1;
+	}
+	ptrace(PTRACE_SETOPTIONS, pid, NULL,
+	       (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE
+	                      | PTRACE_O_EXITKILL));
+	ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+	for (;;)
+	{
+		tid = waitpid(-1, &status, __WALL);
+		if (tid == -1)
+		{
+			break;
+		}
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+		{
+			/* the last call of a thread never returns */
+			++ends;
+			if (tid == pid)
+			{
+				break;
+			}
+			continue;
+		}
+		sig = 0;
+		if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+		{
+			++stops;
+		}
+		else if (WSTOPSIG(status) != SIGTRAP
+		         && WSTOPSIG(status) != SIGSTOP)
+		{
+			/* a real signal, which the command should still see */
+			sig = WSTOPSIG(status);
+		}
+		ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(long)sig);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		errx(EXIT_FAILURE, "%s failed", argv[0]);
+	}
+	return (stops + ends) / 2;
+#else
+	(void)argv;
+	(void)in;
+	(void)out;
+	return -1;
+#endif
+}
+
+
+void
+print_help()
+{
+	PERR("mdbench Copyright (c) 2026, Dakotah Lambert.\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: mdbench gen [-f bin|smd] [-p random|low] [-s seed]");
+	PERR(" megabits outfile\n");
+	PERR("       mdbench run [-n runs] [-i infile] [-o outfile]");
+	PERR(" command [arg ...]\n");
+	PERR("       mdbench -l\n\n");
+	PERR("  gen : write a rom with a valid header and checksum,\n");
+	PERR("        the same for the same arguments on any machine\n");
+	PERR("    -f  : BIN (default) or SMD\n");
+	PERR("    -p  : random bytes (default), or low-entropy: mostly\n");
+	PERR("          0xFF with a few tiles of repeated bytes\n");
+	PERR("    -s  : seed for the payload (default 1)\n");
+	PERR("  run : print the best of `runs' (default 5) wall-clock times\n");
+	PERR("        of command, in seconds, and how many system calls\n");
+	PERR("        a run made (-1 if they cannot be counted here)\n");
+	PERR("    -i  : standard input of the command (default /dev/null)\n");
+	PERR("    -o  : standard output of the command (default /dev/null)\n");
+	PERR("  -l  : display license information\n\n");
+}
+
+void
+print_license()
+{
+	PERR("\n mdbench\n\
+ Copyright (c) 2026, Dakotah Lambert\n\
+ All rights reserved.\n\
+\n\
+ Redistribution and use in source and binary forms, with or without\n\
+ modification, are permitted provided that the following conditions\n\
+ are met:\n\
+\n\
+ 1: Redistributions of source code must retain the above copyright\n\
+    notice, this list of conditions and the following disclaimer.\n\
+\n\
+ 2: Redistributions in binary form must reproduce the above copyright\n\
+    notice, this list of conditions and the following disclaimer in\n\
+    the documentation and/or other materials provided with the\n\
+    distribution.\n\
+\n\
+ 3: Neither the names of copyright holders nor the names of their\n\
+    contributors may be used to endors or promote products derived\n\
+    from this software without specific prior written permission.\n\
+\n\
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS\n\
+  \"AS IS\" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT\n\
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS\n\
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED, IN NO EVENT SHALL THE\n\
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,\n\
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,\n\
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;\n\
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER\n\
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT\n\
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN\n\
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE\n\
+  POSSIBILITY OF SUCH DAMAGE.\n\n");
+}
@@ -0,0 +1,386 @@
+/*****************************************************************************
+ * checksum: the Genesis header checksum, and CRC-32
+ * See checksum.h for a description of each.
+ ****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+
+#include "checksum.h"
+#include "kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#define CRC32_POLYNOMIAL 0xedb88320UL
+
+typedef unsigned int (*checksum_kernel)(unsigned char const*, size_t);
+
+static checksum_kernel select_checksum_kernel(void);
+static unsigned int checksum_scalar(unsigned char const*, size_t);
+#ifdef HAVE_X86_KERNELS
+static unsigned int checksum_sse2(unsigned char const*, size_t);
+static unsigned int checksum_avx2(unsigned char const*, size_t);
+#endif
+static void make_crc32_tables(void);
+static uint32_t gf2_times(uint32_t const*, uint32_t);
+static void gf2_square(uint32_t*, uint32_t const*);
+
+/* slice-by-8 tables, built once on first use */
+static uint32_t crc32_tables[8][256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+
+void
+rom_checksum_init(struct rom_checksum *state, off_t offset)
+{
+	state->sum = 0;
+	state->offset = offset;
+}
+
+void
+rom_checksum_update(struct rom_checksum *state,
+                    unsigned char const *data, size_t length)
+{
+	size_t skip;
+
+	if (state->offset < ROM_DATA_START)
+	{
+		skip = ROM_DATA_START - state->offset;
+		skip = (skip < length) ? skip : length;
+		state->offset += skip;
+		data += skip;
+		length -= skip;
+	}
+	if (length == 0)
+	{
+		return;
+	}
+	if (state->offset % 2 != 0)
+	{
+		/* finish the word begun by the previous piece */
+		state->sum = (state->sum + data[0]) % 65536;
+		++state->offset;
+		++data;
+		--length;
+	}
+	state->sum = (state->sum + select_checksum_kernel()(data, length))
+		% 65536;
+	state->offset += length;
+}
+
+unsigned int
+rom_calculate_checksum(unsigned char const *rom, size_t size)
+{
+	if (size <= ROM_DATA_START)
+	{
+		return 0;
+	}
+	return select_checksum_kernel()(rom + ROM_DATA_START,
+	                                size - ROM_DATA_START);
+}
+
+/* Bytes at even offsets are the high halves of words, so they count
+ * 256 times over; only the number of each kind matters.
+ */
+unsigned int
+rom_fill_checksum(off_t start, off_t end, unsigned char fill)
+{
+	unsigned long evens, odds;
+
+	if (start < ROM_DATA_START)
+	{
+		start = ROM_DATA_START;
+	}
+	if (end <= start)
+	{
+		return 0;
+	}
+	evens = ((end + 1) / 2 - (start + 1) / 2) % 65536;
+	odds = (end / 2 - start / 2) % 65536;
+	return (evens * 256 * fill + odds * fill) % 65536;
+}
+
+unsigned int
+rom_find_stored_checksum(unsigned char const *rom, size_t size)
+{
+	if (size < ROM_CHECKSUM_LOCATION + 2)
+	{
+		return 0;
+	}
+	return rom_stored_checksum(rom);
+}
+
+void
+rom_fix_checksum(unsigned char *rom, size_t size, unsigned int checksum)
+{
+	if (size < ROM_CHECKSUM_LOCATION + 2)
+	{
+		return;
+	}
+	rom[ROM_CHECKSUM_LOCATION] = (checksum / 256) % 256;
+	rom[ROM_CHECKSUM_LOCATION + 1] = checksum % 256;
+}
+
+unsigned int
+rom_stored_checksum(unsigned char const *header)
+{
+	return header[ROM_CHECKSUM_LOCATION] * 256
+		+ header[ROM_CHECKSUM_LOCATION + 1];
+}
+
+unsigned long
+rom_header_size(unsigned char const *header)
+{
+	unsigned long size = 0;
+	int i;
+
+	for (i = 0; i < 4; ++i)
+	{
+		size = size * 256 + header[ROM_SIZE_LOCATION + i];
+	}
+	return size;
+}
+
+
+/* Sum the words of `buffer' with the kernel for the level in use
+ * (see kernel.h).  A trailing odd byte is the high half of a word.
+ */
+static checksum_kernel
+select_checksum_kernel(void)
+{
+#ifdef HAVE_X86_KERNELS
+	switch (rom_kernel_level())
+	{
+	case ROM_KERNEL_AVX2:
+		return checksum_avx2;
+	case ROM_KERNEL_SSE2:
+		return checksum_sse2;
+	default:
+		break;
+	}
+#endif
+	return checksum_scalar;
+}
+
+static unsigned int
+checksum_scalar(unsigned char const *buffer, size_t size)
+{
+	unsigned int checksum = 0;
+	size_t i;
+
+	for (i = 0; i + 1 < size; i += 2)
+	{
+		checksum += buffer[i] * 256 + buffer[i + 1];
+		checksum %= 65536;
+	}
+	if (i < size)
+	{
+		checksum += buffer[i] * 256;
+		checksum %= 65536;
+	}
+	return checksum;
+}
+
+#ifdef HAVE_X86_KERNELS
+/* The vector kernels keep two running totals in 64-bit lanes:
+ * the sum of every byte, and the sum of the even-offset (high-order) bytes.
+ * Since each word is hi * 256 + lo, the checksum is
+ *   (hi_sum * 256 + (all_sum - hi_sum)) mod 65536,
+ * and as 65536 divides 2**32, truncating the totals to unsigned int is exact.
+ */
+__attribute__((target("sse2")))
+static unsigned int
+checksum_sse2(unsigned char const *buffer, size_t size)
+{
+	__m128i const zero = _mm_setzero_si128();
+	__m128i const even = _mm_set1_epi16(0x00ff);
+	__m128i all_sum = zero;
+	__m128i hi_sum = zero;
+	unsigned int all, hi;
+	size_t i;
+
+	for (i = 0; i + 16 <= size; i += 16)
+	{
+		__m128i const v = _mm_loadu_si128((__m128i const *)(buffer + i));
+		all_sum = _mm_add_epi64(all_sum, _mm_sad_epu8(v, zero));
+		hi_sum = _mm_add_epi64(hi_sum,
+		                       _mm_sad_epu8(_mm_and_si128(v, even), zero));
+	}
+	all_sum = _mm_add_epi64(all_sum, _mm_unpackhi_epi64(all_sum, all_sum));
+	hi_sum = _mm_add_epi64(hi_sum, _mm_unpackhi_epi64(hi_sum, hi_sum));
+	all = (unsigned int)_mm_cvtsi128_si32(all_sum);
+	hi = (unsigned int)_mm_cvtsi128_si32(hi_sum);
+
+	return (hi * 256 + (all - hi) + checksum_scalar(buffer + i, size - i))
+		% 65536;
+}
+
+__attribute__((target("avx2")))
+static unsigned int
+checksum_avx2(unsigned char const *buffer, size_t size)
+{
+	__m256i const zero = _mm256_setzero_si256();
+	__m256i const even = _mm256_set1_epi16(0x00ff);
+	__m256i all_sum = zero;
+	__m256i hi_sum = zero;
+	__m128i all_half, hi_half;
+	unsigned int all, hi;
+	size_t i;
+
+	for (i = 0; i + 32 <= size; i += 32)
+	{
+		__m256i const v = _mm256_loadu_si256((__m256i const *)(buffer + i));
+		all_sum = _mm256_add_epi64(all_sum, _mm256_sad_epu8(v, zero));
+		hi_sum = _mm256_add_epi64(hi_sum,
+		                          _mm256_sad_epu8(_mm256_and_si256(v, even),
+		                                          zero));
+	}
+	all_half = _mm_add_epi64(_mm256_castsi256_si128(all_sum),
+	                         _mm256_extracti128_si256(all_sum, 1));
+	hi_half = _mm_add_epi64(_mm256_castsi256_si128(hi_sum),
+	                        _mm256_extracti128_si256(hi_sum, 1));
+	all_half = _mm_add_epi64(all_half, _mm_unpackhi_epi64(all_half, all_half));
+	hi_half = _mm_add_epi64(hi_half, _mm_unpackhi_epi64(hi_half, hi_half));
+	all = (unsigned int)_mm_cvtsi128_si32(all_half);
+	hi = (unsigned int)_mm_cvtsi128_si32(hi_half);
+
+	return (hi * 256 + (all - hi) + checksum_scalar(buffer + i, size - i))
+		% 65536;
+}
+#endif
+
+
+/* CRC-32 eight bytes at a time: table k gives the effect of a byte
+ * followed by k zero bytes, so the eight lookups are independent.
+ */
+uint32_t
+rom_crc32_update(uint32_t crc, unsigned char const *data, size_t length)
+{
+	uint32_t lo, hi;
+
+	pthread_once(&crc32_once, make_crc32_tables);
+	crc = ~crc;
+	while (length >= 8)
+	{
+		lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8
+		            | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+		hi = (uint32_t)data[4] | (uint32_t)data[5] << 8
+			| (uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+		crc = crc32_tables[7][lo & 0xff]
+			^ crc32_tables[6][(lo >> 8) & 0xff]
+			^ crc32_tables[5][(lo >> 16) & 0xff]
+			^ crc32_tables[4][lo >> 24]
+			^ crc32_tables[3][hi & 0xff]
+			^ crc32_tables[2][(hi >> 8) & 0xff]
+			^ crc32_tables[1][(hi >> 16) & 0xff]
+			^ crc32_tables[0][hi >> 24];
+		data += 8;
+		length -= 8;
+	}
+	while (length-- > 0)
+	{
+		crc = crc32_tables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void
+make_crc32_tables(void)
+{
+	uint32_t c;
+	int i, j;
+
+	for (i = 0; i < 256; ++i)
+	{
+		c = i;
+		for (j = 0; j < 8; ++j)
+		{
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLYNOMIAL : c >> 1;
+		}
+		crc32_tables[0][i] = c;
+	}
+	for (i = 0; i < 256; ++i)
+	{
+		for (j = 1; j < 8; ++j)
+		{
+			c = crc32_tables[j - 1][i];
+			crc32_tables[j][i] = crc32_tables[0][c & 0xff] ^ (c >> 8);
+		}
+	}
+}
+
+/* Appending `length2' zero bytes to a message is a linear map on its CRC,
+ * applied here by repeated squaring of the one-zero-bit operator,
+ * as in zlib's crc32_combine.
+ */
+uint32_t
+rom_crc32_combine(uint32_t crc1, uint32_t crc2, off_t length2)
+{
+	uint32_t even[32];
+	uint32_t odd[32];
+	uint32_t row;
+	int n;
+
+	if (length2 <= 0)
+	{
+		return crc1;
+	}
+	odd[0] = CRC32_POLYNOMIAL;
+	row = 1;
+	for (n = 1; n < 32; ++n)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+	gf2_square(even, odd);  /* two zero bits */
+	gf2_square(odd, even);  /* four zero bits */
+	do
+	{
+		/* the first square puts one zero byte in `even' */
+		gf2_square(even, odd);
+		if (length2 & 1)
+		{
+			crc1 = gf2_times(even, crc1);
+		}
+		length2 >>= 1;
+		if (length2 == 0)
+		{
+			break;
+		}
+		gf2_square(odd, even);
+		if (length2 & 1)
+		{
+			crc1 = gf2_times(odd, crc1);
+		}
+		length2 >>= 1;
+	} while (length2 != 0);
+	return crc1 ^ crc2;
+}
+
+static uint32_t
+gf2_times(uint32_t const *matrix, uint32_t vector)
+{
+	uint32_t sum = 0;
+
+	for (; vector != 0; vector >>= 1, ++matrix)
+	{
+		if (vector & 1)
+		{
+			sum ^= *matrix;
+		}
+	}
+	return sum;
+}
+
+static void
+gf2_square(uint32_t *square, uint32_t const *matrix)
+{
+	int n;
+
+	for (n = 0; n < 32; ++n)
+	{
+		square[n] = gf2_times(matrix, matrix[n]);
+	}
+}
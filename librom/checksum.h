@@ -0,0 +1,75 @@
+/*****************************************************************************
+ * checksum: the Genesis header checksum, and CRC-32
+ *
+ * The Genesis checksum is the sum, modulo 65536, of the big-endian words
+ * from 0x200 to the end of the rom; the end is normally the size field
+ * of the header, and the result is stored at 0x18e.
+ * Both checksums can be computed a piece at a time, and both can be
+ * computed over separate stretches of a rom and combined afterwards.
+ ****************************************************************************/
+#ifndef ROM_CHECKSUM_H
+#define ROM_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define ROM_CHECKSUM_LOCATION 0x18e
+#define ROM_SIZE_LOCATION     0x1a4
+#define ROM_DATA_START        0x200
+#define ROM_HEADER_SIZE       0x200
+
+/* running Genesis checksum over a rom that arrives in pieces */
+struct rom_checksum
+{
+	/* sum so far, modulo 65536 */
+	unsigned int sum;
+	/* offset in the rom of the next byte, including the header */
+	off_t offset;
+};
+
+/* Start a checksum at `offset' bytes into the rom.
+ * Sums started at different offsets and fed adjoining stretches
+ * of the rom combine by addition modulo 65536.
+ */
+void rom_checksum_init(struct rom_checksum *state, off_t offset);
+
+/* Fold the next `length' bytes of the rom into a running checksum.
+ * Bytes before ROM_DATA_START are skipped; a word split between two
+ * pieces is summed as its two halves.
+ */
+void rom_checksum_update(struct rom_checksum *state,
+                         unsigned char const *data, size_t length);
+
+/* The checksum of a whole rom of `size' bytes held in memory. */
+unsigned int rom_calculate_checksum(unsigned char const *rom, size_t size);
+
+/* What bytes `start' to `end' of a rom add to its checksum if every one
+ * of them is `fill', as padding is: each whole word adds fill * 0x0101.
+ * Combines with other sums by addition modulo 65536.
+ */
+unsigned int rom_fill_checksum(off_t start, off_t end, unsigned char fill);
+
+/* Read or replace the checksum stored in the first `size' bytes of a rom.
+ * If they stop short of the checksum field, the stored checksum
+ * reads as zero and is left alone.
+ */
+unsigned int rom_find_stored_checksum(unsigned char const *rom, size_t size);
+void rom_fix_checksum(unsigned char *rom, size_t size, unsigned int checksum);
+
+/* The checksum and rom size recorded in a header of ROM_HEADER_SIZE bytes */
+unsigned int rom_stored_checksum(unsigned char const *header);
+unsigned long rom_header_size(unsigned char const *header);
+
+/* Fold `length' bytes into a CRC-32 (as used by zip and zlib)
+ * begun at zero.
+ */
+uint32_t rom_crc32_update(uint32_t crc, unsigned char const *data,
+                          size_t length);
+
+/* The CRC-32 of two adjoining stretches, given the CRC-32 of each
+ * and the length of the second.
+ */
+uint32_t rom_crc32_combine(uint32_t crc1, uint32_t crc2, off_t length2);
+
+#endif
@@ -0,0 +1,139 @@
+/*****************************************************************************
+ * detect: tell what kind of rom image a file holds
+ * See detect.h for the signatures.
+ ****************************************************************************/
+#include <string.h>
+
+#include "detect.h"
+
+#define SIGNATURE_LOCATION 0x100
+#define SMD_MARKER_LOCATION 8
+#define HALF_BLOCK (ROM_SMD_BLOCK_SIZE / 2)
+
+static int has(unsigned char const*, size_t, size_t, char const*);
+static int has_interleaved(unsigned char const*, size_t, size_t, char const*);
+
+
+enum rom_format
+rom_detect(unsigned char const *data, size_t length, off_t size, int *score)
+{
+	int scores[ROM_FORMAT_PADDED + 1] = {0};
+	enum rom_format best = ROM_FORMAT_UNKNOWN;
+	int f;
+
+	if (length > ROM_DETECT_SIZE)
+	{
+		length = ROM_DETECT_SIZE;
+	}
+
+	if (has(data, length, SIGNATURE_LOCATION, "SEGA"))
+	{
+		scores[ROM_FORMAT_BIN] += 4;
+	}
+
+	if (has(data, length, SMD_MARKER_LOCATION, "\xAA\xBB"))
+	{
+		scores[ROM_FORMAT_SMD] += 2;
+		if (length > SMD_MARKER_LOCATION + 2
+		    && data[SMD_MARKER_LOCATION + 2] == 0x06)
+		{
+			scores[ROM_FORMAT_SMD] += 1;
+		}
+	}
+	if (has_interleaved(data, length, SIGNATURE_LOCATION, "SEGA"))
+	{
+		scores[ROM_FORMAT_SMD] += 4;
+	}
+
+	if (has(data, length, SIGNATURE_LOCATION, "ESAG"))
+	{
+		scores[ROM_FORMAT_SWAPPED] += 4;
+	}
+
+	if (has(data, length, ROM_SMD_HEADER_SIZE + SIGNATURE_LOCATION, "SEGA"))
+	{
+		scores[ROM_FORMAT_PADDED] += 4;
+	}
+
+	/* a fitting size only counts towards a format still in the running */
+	if (size >= 0)
+	{
+		if (scores[ROM_FORMAT_SMD] > 0 && size >= ROM_SMD_HEADER_SIZE
+		    && (size - ROM_SMD_HEADER_SIZE) % ROM_SMD_BLOCK_SIZE == 0)
+		{
+			scores[ROM_FORMAT_SMD] += 1;
+		}
+		if (scores[ROM_FORMAT_PADDED] > 0
+		    && size % ROM_SMD_BLOCK_SIZE == ROM_SMD_HEADER_SIZE)
+		{
+			scores[ROM_FORMAT_PADDED] += 1;
+		}
+		if (scores[ROM_FORMAT_SWAPPED] > 0 && size % 2 == 0)
+		{
+			scores[ROM_FORMAT_SWAPPED] += 1;
+		}
+	}
+
+	/* ties go to the more common format, listed first */
+	for (f = ROM_FORMAT_BIN; f <= ROM_FORMAT_PADDED; ++f)
+	{
+		if (scores[f] > scores[best])
+		{
+			best = f;
+		}
+	}
+	if (score != NULL)
+	{
+		*score = scores[best];
+	}
+	return best;
+}
+
+char const *
+rom_format_name(enum rom_format format)
+{
+	switch (format)
+	{
+	case ROM_FORMAT_BIN:
+		return "BIN";
+	case ROM_FORMAT_SMD:
+		return "SMD";
+	case ROM_FORMAT_SWAPPED:
+		return "SWAPPED";
+	case ROM_FORMAT_PADDED:
+		return "PADDED";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+
+/* Whether `str' is at `offset' of the data */
+static int
+has(unsigned char const *data, size_t length, size_t offset, char const *str)
+{
+	size_t n = strlen(str);
+
+	return offset + n <= length && memcmp(data + offset, str, n) == 0;
+}
+
+/* Whether `str' would be at `offset' of the BIN data held in the first
+ * SMD block, whose first half holds the odd bytes and second the even.
+ */
+static int
+has_interleaved(unsigned char const *data, size_t length, size_t offset,
+                char const *str)
+{
+	size_t i, at;
+
+	for (i = 0; str[i] != '\0'; ++i)
+	{
+		at = ROM_SMD_HEADER_SIZE + (offset + i) / 2
+			+ (((offset + i) % 2 == 0) ? HALF_BLOCK : 0);
+		if (at >= length || data[at] != (unsigned char)str[i])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,44 @@
+/*****************************************************************************
+ * detect: tell what kind of rom image a file holds
+ *
+ * Each format is scored on the signatures it would show, all within the
+ * first ROM_DETECT_SIZE bytes (an SMD header and its first block):
+ *   BIN      "SEGA" at 0x100
+ *   SMD      the 0xAA 0xBB 0x06 marker at 8 that bin2smd writes,
+ *            and "SEGA" at 0x100 once the first block is deinterleaved
+ *   SWAPPED  a BIN rom with the bytes of each word swapped ("ESAG")
+ *   PADDED   a BIN rom behind ROM_SMD_HEADER_SIZE bytes of copier header
+ *            or padding, but not interleaved
+ * A file size that fits the format adds to its score.
+ ****************************************************************************/
+#ifndef ROM_DETECT_H
+#define ROM_DETECT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "smd.h"
+
+#define ROM_DETECT_SIZE (ROM_SMD_HEADER_SIZE + ROM_SMD_BLOCK_SIZE)
+
+enum rom_format
+{
+	ROM_FORMAT_UNKNOWN,
+	ROM_FORMAT_BIN,
+	ROM_FORMAT_SMD,
+	ROM_FORMAT_SWAPPED,
+	ROM_FORMAT_PADDED
+};
+
+/* Classify a rom from its first `length' bytes and its total `size'
+ * (or -1 if not known).  Only the first ROM_DETECT_SIZE bytes are
+ * looked at.  If `score' is not NULL, it is set to the winning score;
+ * a format without any of its signatures is never chosen.
+ */
+enum rom_format rom_detect(unsigned char const *data, size_t length,
+                           off_t size, int *score);
+
+/* "BIN", "SMD", "SWAPPED", "PADDED" or "UNKNOWN" */
+char const *rom_format_name(enum rom_format format);
+
+#endif
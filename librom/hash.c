@@ -0,0 +1,292 @@
+/*****************************************************************************
+ * hash: MD5 and SHA-1, as listed for each rom in DAT files
+ * See hash.h for a description of each.
+ * MD5 is as in RFC 1321, SHA-1 as in FIPS 180-4.
+ ****************************************************************************/
+#include <string.h>
+
+#include "hash.h"
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/* the MD5 round functions */
+#define MD5_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD5_G(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, k, s) \
+	((a) += f((b), (c), (d)) + (x) + (k), \
+	 (a) = ROTL((a), (s)) + (b))
+/* one SHA-1 round, with round function `f' and constant `k' */
+#define SHA1_STEP(f, k) \
+	(t = ROTL(a, 5) + (f) + e + (k) + w[i], \
+	 e = d, d = c, c = ROTL(b, 30), b = a, a = t)
+
+typedef void (*block_hasher)(uint32_t*, unsigned char const*);
+
+static void md5_block(uint32_t*, unsigned char const*);
+static void sha1_block(uint32_t*, unsigned char const*);
+static void update(uint32_t*, uint64_t*, unsigned char*, block_hasher,
+                   unsigned char const*, size_t);
+static void finish(uint32_t*, uint64_t, unsigned char*, block_hasher, int);
+static uint32_t load_le(unsigned char const*);
+static uint32_t load_be(unsigned char const*);
+
+
+void
+rom_md5_init(struct rom_md5 *md5)
+{
+	md5->state[0] = 0x67452301;
+	md5->state[1] = 0xefcdab89;
+	md5->state[2] = 0x98badcfe;
+	md5->state[3] = 0x10325476;
+	md5->length = 0;
+}
+
+void
+rom_md5_update(struct rom_md5 *md5, unsigned char const *data,
+               size_t length)
+{
+	update(md5->state, &md5->length, md5->block, md5_block, data, length);
+}
+
+void
+rom_md5_final(struct rom_md5 *md5, unsigned char *digest)
+{
+	int i;
+
+	finish(md5->state, md5->length, md5->block, md5_block, 0);
+	for (i = 0; i < 16; ++i)
+	{
+		digest[i] = md5->state[i / 4] >> (8 * (i % 4));
+	}
+}
+
+void
+rom_sha1_init(struct rom_sha1 *sha1)
+{
+	sha1->state[0] = 0x67452301;
+	sha1->state[1] = 0xefcdab89;
+	sha1->state[2] = 0x98badcfe;
+	sha1->state[3] = 0x10325476;
+	sha1->state[4] = 0xc3d2e1f0;
+	sha1->length = 0;
+}
+
+void
+rom_sha1_update(struct rom_sha1 *sha1, unsigned char const *data,
+                size_t length)
+{
+	update(sha1->state, &sha1->length, sha1->block, sha1_block,
+	       data, length);
+}
+
+void
+rom_sha1_final(struct rom_sha1 *sha1, unsigned char *digest)
+{
+	int i;
+
+	finish(sha1->state, sha1->length, sha1->block, sha1_block, 1);
+	for (i = 0; i < 20; ++i)
+	{
+		digest[i] = sha1->state[i / 4] >> (24 - 8 * (i % 4));
+	}
+}
+
+
+/* Hash whole blocks straight from `data', keeping any remainder
+ * in `block' until the next piece completes it.
+ */
+static void
+update(uint32_t *state, uint64_t *total, unsigned char *block,
+       block_hasher hash, unsigned char const *data, size_t length)
+{
+	size_t fill = *total % 64;
+	size_t n;
+
+	*total += length;
+	if (fill > 0)
+	{
+		n = (64 - fill < length) ? 64 - fill : length;
+		memcpy(block + fill, data, n);
+		data += n;
+		length -= n;
+		if (fill + n < 64)
+		{
+			return;
+		}
+		hash(state, block);
+	}
+	for (; length >= 64; data += 64, length -= 64)
+	{
+		hash(state, data);
+	}
+	memcpy(block, data, length);
+}
+
+/* Pad the last block with 0x80, zeros and the length in bits,
+ * stored big-endian for SHA-1 and little-endian for MD5.
+ */
+static void
+finish(uint32_t *state, uint64_t total, unsigned char *block,
+       block_hasher hash, int big_endian)
+{
+	size_t fill = total % 64;
+	uint64_t bits = total * 8;
+	int i;
+
+	block[fill++] = 0x80;
+	if (fill > 56)
+	{
+		memset(block + fill, 0, 64 - fill);
+		hash(state, block);
+		fill = 0;
+	}
+	memset(block + fill, 0, 56 - fill);
+	for (i = 0; i < 8; ++i)
+	{
+		block[big_endian ? 63 - i : 56 + i] = bits >> (8 * i);
+	}
+	hash(state, block);
+}
+
+static void
+md5_block(uint32_t *state, unsigned char const *data)
+{
+	uint32_t x[16];
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	int i;
+
+	for (i = 0; i < 16; ++i)
+	{
+		x[i] = load_le(data + 4 * i);
+	}
+
+	MD5_STEP(MD5_F, a, b, c, d, x[ 0], 0xd76aa478,  7);
+	MD5_STEP(MD5_F, d, a, b, c, x[ 1], 0xe8c7b756, 12);
+	MD5_STEP(MD5_F, c, d, a, b, x[ 2], 0x242070db, 17);
+	MD5_STEP(MD5_F, b, c, d, a, x[ 3], 0xc1bdceee, 22);
+	MD5_STEP(MD5_F, a, b, c, d, x[ 4], 0xf57c0faf,  7);
+	MD5_STEP(MD5_F, d, a, b, c, x[ 5], 0x4787c62a, 12);
+	MD5_STEP(MD5_F, c, d, a, b, x[ 6], 0xa8304613, 17);
+	MD5_STEP(MD5_F, b, c, d, a, x[ 7], 0xfd469501, 22);
+	MD5_STEP(MD5_F, a, b, c, d, x[ 8], 0x698098d8,  7);
+	MD5_STEP(MD5_F, d, a, b, c, x[ 9], 0x8b44f7af, 12);
+	MD5_STEP(MD5_F, c, d, a, b, x[10], 0xffff5bb1, 17);
+	MD5_STEP(MD5_F, b, c, d, a, x[11], 0x895cd7be, 22);
+	MD5_STEP(MD5_F, a, b, c, d, x[12], 0x6b901122,  7);
+	MD5_STEP(MD5_F, d, a, b, c, x[13], 0xfd987193, 12);
+	MD5_STEP(MD5_F, c, d, a, b, x[14], 0xa679438e, 17);
+	MD5_STEP(MD5_F, b, c, d, a, x[15], 0x49b40821, 22);
+
+	MD5_STEP(MD5_G, a, b, c, d, x[ 1], 0xf61e2562,  5);
+	MD5_STEP(MD5_G, d, a, b, c, x[ 6], 0xc040b340,  9);
+	MD5_STEP(MD5_G, c, d, a, b, x[11], 0x265e5a51, 14);
+	MD5_STEP(MD5_G, b, c, d, a, x[ 0], 0xe9b6c7aa, 20);
+	MD5_STEP(MD5_G, a, b, c, d, x[ 5], 0xd62f105d,  5);
+	MD5_STEP(MD5_G, d, a, b, c, x[10], 0x02441453,  9);
+	MD5_STEP(MD5_G, c, d, a, b, x[15], 0xd8a1e681, 14);
+	MD5_STEP(MD5_G, b, c, d, a, x[ 4], 0xe7d3fbc8, 20);
+	MD5_STEP(MD5_G, a, b, c, d, x[ 9], 0x21e1cde6,  5);
+	MD5_STEP(MD5_G, d, a, b, c, x[14], 0xc33707d6,  9);
+	MD5_STEP(MD5_G, c, d, a, b, x[ 3], 0xf4d50d87, 14);
+	MD5_STEP(MD5_G, b, c, d, a, x[ 8], 0x455a14ed, 20);
+	MD5_STEP(MD5_G, a, b, c, d, x[13], 0xa9e3e905,  5);
+	MD5_STEP(MD5_G, d, a, b, c, x[ 2], 0xfcefa3f8,  9);
+	MD5_STEP(MD5_G, c, d, a, b, x[ 7], 0x676f02d9, 14);
+	MD5_STEP(MD5_G, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+	MD5_STEP(MD5_H, a, b, c, d, x[ 5], 0xfffa3942,  4);
+	MD5_STEP(MD5_H, d, a, b, c, x[ 8], 0x8771f681, 11);
+	MD5_STEP(MD5_H, c, d, a, b, x[11], 0x6d9d6122, 16);
+	MD5_STEP(MD5_H, b, c, d, a, x[14], 0xfde5380c, 23);
+	MD5_STEP(MD5_H, a, b, c, d, x[ 1], 0xa4beea44,  4);
+	MD5_STEP(MD5_H, d, a, b, c, x[ 4], 0x4bdecfa9, 11);
+	MD5_STEP(MD5_H, c, d, a, b, x[ 7], 0xf6bb4b60, 16);
+	MD5_STEP(MD5_H, b, c, d, a, x[10], 0xbebfbc70, 23);
+	MD5_STEP(MD5_H, a, b, c, d, x[13], 0x289b7ec6,  4);
+	MD5_STEP(MD5_H, d, a, b, c, x[ 0], 0xeaa127fa, 11);
+	MD5_STEP(MD5_H, c, d, a, b, x[ 3], 0xd4ef3085, 16);
+	MD5_STEP(MD5_H, b, c, d, a, x[ 6], 0x04881d05, 23);
+	MD5_STEP(MD5_H, a, b, c, d, x[ 9], 0xd9d4d039,  4);
+	MD5_STEP(MD5_H, d, a, b, c, x[12], 0xe6db99e5, 11);
+	MD5_STEP(MD5_H, c, d, a, b, x[15], 0x1fa27cf8, 16);
+	MD5_STEP(MD5_H, b, c, d, a, x[ 2], 0xc4ac5665, 23);
+
+	MD5_STEP(MD5_I, a, b, c, d, x[ 0], 0xf4292244,  6);
+	MD5_STEP(MD5_I, d, a, b, c, x[ 7], 0x432aff97, 10);
+	MD5_STEP(MD5_I, c, d, a, b, x[14], 0xab9423a7, 15);
+	MD5_STEP(MD5_I, b, c, d, a, x[ 5], 0xfc93a039, 21);
+	MD5_STEP(MD5_I, a, b, c, d, x[12], 0x655b59c3,  6);
+	MD5_STEP(MD5_I, d, a, b, c, x[ 3], 0x8f0ccc92, 10);
+	MD5_STEP(MD5_I, c, d, a, b, x[10], 0xffeff47d, 15);
+	MD5_STEP(MD5_I, b, c, d, a, x[ 1], 0x85845dd1, 21);
+	MD5_STEP(MD5_I, a, b, c, d, x[ 8], 0x6fa87e4f,  6);
+	MD5_STEP(MD5_I, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+	MD5_STEP(MD5_I, c, d, a, b, x[ 6], 0xa3014314, 15);
+	MD5_STEP(MD5_I, b, c, d, a, x[13], 0x4e0811a1, 21);
+	MD5_STEP(MD5_I, a, b, c, d, x[ 4], 0xf7537e82,  6);
+	MD5_STEP(MD5_I, d, a, b, c, x[11], 0xbd3af235, 10);
+	MD5_STEP(MD5_I, c, d, a, b, x[ 2], 0x2ad7d2bb, 15);
+	MD5_STEP(MD5_I, b, c, d, a, x[ 9], 0xeb86d391, 21);
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+static void
+sha1_block(uint32_t *state, unsigned char const *data)
+{
+	uint32_t w[80];
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4];
+	uint32_t t;
+	int i;
+
+	for (i = 0; i < 16; ++i)
+	{
+		w[i] = load_be(data + 4 * i);
+	}
+	for (; i < 80; ++i)
+	{
+		w[i] = ROTL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+	for (i = 0; i < 20; ++i)
+	{
+		SHA1_STEP(d ^ (b & (c ^ d)), 0x5a827999);
+	}
+	for (; i < 40; ++i)
+	{
+		SHA1_STEP(b ^ c ^ d, 0x6ed9eba1);
+	}
+	for (; i < 60; ++i)
+	{
+		SHA1_STEP((b & c) | (d & (b | c)), 0x8f1bbcdc);
+	}
+	for (; i < 80; ++i)
+	{
+		SHA1_STEP(b ^ c ^ d, 0xca62c1d6);
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+static uint32_t
+load_le(unsigned char const *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8
+		| (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t
+load_be(unsigned char const *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+		| (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
@@ -0,0 +1,51 @@
+/*****************************************************************************
+ * hash: MD5 and SHA-1, as listed for each rom in DAT files
+ *
+ * Both are computed a piece at a time, like the checksums in
+ * checksum.h, so that a rom can be hashed as it streams past.
+ * They are here to identify dumps, not to resist an attacker.
+ ****************************************************************************/
+#ifndef ROM_HASH_H
+#define ROM_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROM_MD5_SIZE  16
+#define ROM_SHA1_SIZE 20
+
+/* running MD5 */
+struct rom_md5
+{
+	uint32_t state[4];
+	/* bytes so far */
+	uint64_t length;
+	/* the part of a 64-byte block not yet hashed */
+	unsigned char block[64];
+};
+
+/* running SHA-1 */
+struct rom_sha1
+{
+	uint32_t state[5];
+	/* bytes so far */
+	uint64_t length;
+	/* the part of a 64-byte block not yet hashed */
+	unsigned char block[64];
+};
+
+/* Start a hash, fold in the next `length' bytes, or finish it and
+ * write the digest to `digest'.  A finished hash must be started
+ * again before it is used.
+ */
+void rom_md5_init(struct rom_md5 *md5);
+void rom_md5_update(struct rom_md5 *md5, unsigned char const *data,
+                    size_t length);
+void rom_md5_final(struct rom_md5 *md5, unsigned char *digest);
+
+void rom_sha1_init(struct rom_sha1 *sha1);
+void rom_sha1_update(struct rom_sha1 *sha1, unsigned char const *data,
+                     size_t length);
+void rom_sha1_final(struct rom_sha1 *sha1, unsigned char *digest);
+
+#endif
@@ -0,0 +1,93 @@
+/*****************************************************************************
+ * kerncheck: check the checksum kernels against the original function
+ * Every length from 0 to MAX_LENGTH bytes, at every start offset below
+ * MAX_OFFSET (so that each alignment is hit), is summed at each kernel
+ * level the CPU supports (see kernel.h), whole and in two pieces split
+ * at an odd point, and compared with a byte-at-a-time sum of the
+ * big-endian words, a trailing odd byte counting as a high half.
+ * Run by ``make check''; exits with status 1 on the first mismatch.
+ ****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "checksum.h"
+#include "kernel.h"
+
+#define MAX_LENGTH 5000
+#define MAX_OFFSET 70
+
+static int check_level(enum rom_kernel, unsigned char const*);
+
+
+int
+main(void)
+{
+	static unsigned char buffer[ROM_DATA_START + MAX_OFFSET + MAX_LENGTH];
+	unsigned long seed = 0x2545f491;
+	enum rom_kernel level;
+	size_t i;
+
+	for (i = 0; i < sizeof(buffer); ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		buffer[i] = seed >> 16;
+	}
+	for (level = ROM_KERNEL_SCALAR; level <= rom_kernel_best(); ++level)
+	{
+		if (check_level(level, buffer) != 0)
+		{
+			return 1;
+		}
+		printf("checksum %-6s ok\n", rom_kernel_name(level));
+	}
+	return 0;
+}
+
+static int
+check_level(enum rom_kernel level, unsigned char const *buffer)
+{
+	struct rom_checksum state;
+	unsigned char const *data;
+	unsigned int expected, whole, split;
+	size_t offset, length, cut;
+
+	if (rom_kernel_limit(level) != 0)
+	{
+		return 0;
+	}
+	for (offset = 0; offset < MAX_OFFSET; ++offset)
+	{
+		data = buffer + offset;
+		expected = 0;
+		for (length = 0; length <= MAX_LENGTH; ++length)
+		{
+			/* the sum of the first `length' bytes of data */
+			if (length > 0)
+			{
+				expected += data[ROM_DATA_START + length - 1]
+					* ((length % 2) ? 256 : 1);
+				expected %= 65536;
+			}
+			whole = rom_calculate_checksum(data, ROM_DATA_START + length);
+
+			cut = (length / 3) | 1;
+			cut = (cut < length) ? cut : length;
+			rom_checksum_init(&state, ROM_DATA_START);
+			rom_checksum_update(&state, data + ROM_DATA_START, cut);
+			rom_checksum_update(&state, data + ROM_DATA_START + cut,
+			                    length - cut);
+			split = state.sum;
+
+			if (whole != expected || split != expected)
+			{
+				fprintf(stderr, "checksum %s: offset %lu, length %lu: "
+				        "expected 0x%04x, got 0x%04x whole and 0x%04x "
+				        "split at %lu\n", rom_kernel_name(level),
+				        (unsigned long)offset, (unsigned long)length,
+				        expected, whole, split, (unsigned long)cut);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
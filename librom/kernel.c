@@ -0,0 +1,73 @@
+/*****************************************************************************
+ * kernel: which instructions the checksum and split kernels may use
+ * See kernel.h for a description.
+ ****************************************************************************/
+#include <errno.h>
+
+#include "kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS 1
+#endif
+
+/* -1 until the CPU has been asked; asking twice gives the same answer,
+ * so threads that race here do no harm */
+static int best = -1;
+static int limit = ROM_KERNEL_AVX2;
+
+
+enum rom_kernel
+rom_kernel_best(void)
+{
+	if (best < 0)
+	{
+		int level = ROM_KERNEL_SCALAR;
+#ifdef HAVE_X86_KERNELS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+		{
+			level = ROM_KERNEL_AVX2;
+		}
+		else if (__builtin_cpu_supports("sse2"))
+		{
+			level = ROM_KERNEL_SSE2;
+		}
+#endif
+		best = level;
+	}
+	return best;
+}
+
+enum rom_kernel
+rom_kernel_level(void)
+{
+	enum rom_kernel level = rom_kernel_best();
+
+	return ((int)level < limit) ? level : (enum rom_kernel)limit;
+}
+
+int
+rom_kernel_limit(enum rom_kernel level)
+{
+	if (level > rom_kernel_best())
+	{
+		errno = ENOTSUP;
+		return -1;
+	}
+	limit = level;
+	return 0;
+}
+
+char const *
+rom_kernel_name(enum rom_kernel level)
+{
+	switch (level)
+	{
+	case ROM_KERNEL_AVX2:
+		return "avx2";
+	case ROM_KERNEL_SSE2:
+		return "sse2";
+	default:
+		return "scalar";
+	}
+}
@@ -0,0 +1,34 @@
+/*****************************************************************************
+ * kernel: which instructions the checksum and split kernels may use
+ *
+ * Each kernel comes in a scalar version and, on x86, in SSE2 and AVX2
+ * versions; by default the best one the CPU supports is used.  Limiting
+ * the level makes every later call use the best version at or below it,
+ * so that the versions can be timed or checked against each other.
+ ****************************************************************************/
+#ifndef ROM_KERNEL_H
+#define ROM_KERNEL_H
+
+enum rom_kernel
+{
+	ROM_KERNEL_SCALAR,
+	ROM_KERNEL_SSE2,
+	ROM_KERNEL_AVX2
+};
+
+/* The best level the CPU supports. */
+enum rom_kernel rom_kernel_best(void);
+
+/* The level in use. */
+enum rom_kernel rom_kernel_level(void);
+
+/* Use kernels no better than `level' from now on; not to be called while
+ * other threads are using the library.
+ * Returns 0, or -1 with errno set to ENOTSUP if the CPU lacks `level'.
+ */
+int rom_kernel_limit(enum rom_kernel level);
+
+/* "scalar", "sse2" or "avx2" */
+char const *rom_kernel_name(enum rom_kernel level);
+
+#endif
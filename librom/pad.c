@@ -0,0 +1,19 @@
+/*****************************************************************************
+ * pad: fill a rom out to the size of the chip it is burned to
+ ****************************************************************************/
+#include <string.h>
+
+#include "pad.h"
+
+
+size_t
+rom_pad(unsigned char *rom, size_t size, size_t pad_to,
+        unsigned char pad_with)
+{
+	if (size >= pad_to)
+	{
+		return size;
+	}
+	memset(rom + size, pad_with, pad_to - size);
+	return pad_to;
+}
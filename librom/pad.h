@@ -0,0 +1,19 @@
+/*****************************************************************************
+ * pad: fill a rom out to the size of the chip it is burned to
+ ****************************************************************************/
+#ifndef ROM_PAD_H
+#define ROM_PAD_H
+
+#include <stddef.h>
+
+/* bytes in a megabit */
+#define ROM_MBIT (1024 * 1024 / 8)
+
+/* Fill bytes [size, pad_to) of `rom' with `pad_with', and return the
+ * new size of the rom.  A rom already at least `pad_to' bytes long
+ * is left alone.  The buffer must hold `pad_to' bytes.
+ */
+size_t rom_pad(unsigned char *rom, size_t size, size_t pad_to,
+               unsigned char pad_with);
+
+#endif
@@ -0,0 +1,32 @@
+/*****************************************************************************
+ * librom: Sega Genesis / Mega Drive rom handling, as a library
+ *
+ * Everything the command-line tools do to a rom, on memory the caller
+ * owns; nothing here allocates.
+ *   checksum.h  Genesis header checksum and CRC-32
+ *   detect.h    telling BIN, SMD and other images apart
+ *   hash.h      MD5 and SHA-1, as listed in DAT files
+ *   smd.h       BIN <-> SMD conversion
+ *   split.h     hi/lo, 128 kB and other EPROM splits
+ *   pad.h       padding to a chip size
+ *   kernel.h    choosing between the scalar and vector kernels
+ *   stats.h     timing and counting I/O for ROM_STATS
+ * rombuf.h and the file-level functions of split.h, which the tools
+ * themselves use, do allocate.
+ ****************************************************************************/
+#ifndef ROM_H
+#define ROM_H
+
+#define ROM_VERSION "1.0"
+
+#include "checksum.h"
+#include "detect.h"
+#include "hash.h"
+#include "kernel.h"
+#include "pad.h"
+#include "rombuf.h"
+#include "smd.h"
+#include "split.h"
+#include "stats.h"
+
+#endif
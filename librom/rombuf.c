@@ -0,0 +1,383 @@
+/*****************************************************************************
+ * rombuf: hand a rom to the kernels as plain memory
+ * See rombuf.h for how inputs and outputs are handled.
+ ****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rombuf.h"
+#include "stats.h"
+
+/* an unmapped output is written in pieces of at least this size,
+ * unless the caller asks for smaller ones */
+#define OUTPUT_BUFFER_SIZE 0x40000
+
+static int open_input(struct rom_input*, int);
+static int open_output(struct rom_output*, int, off_t, off_t);
+static int grow(unsigned char**, size_t*, size_t);
+static int flush(struct rom_output*);
+
+
+int
+rom_input_open(struct rom_input *in, int fd)
+{
+	struct rom_timer timer;
+	int status;
+
+	rom_stats_begin(&timer);
+	status = open_input(in, fd);
+	rom_stats_end(&timer, ROM_PHASE_OPEN);
+	return status;
+}
+
+static int
+open_input(struct rom_input *in, int fd)
+{
+	struct stat st;
+	void *map;
+
+	memset(in, 0, sizeof(*in));
+	in->fd = fd;
+	in->size = -1;
+	in->pos = lseek(fd, 0, SEEK_CUR);
+	rom_stats_count(ROM_STAT_SEEK_CALLS, 1);
+	if (in->pos == -1)
+	{
+		in->pos = 0;
+	}
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		return 0;
+	}
+	in->size = st.st_size;
+	if (st.st_size == 0 || (off_t)(size_t)st.st_size != st.st_size)
+	{
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		/* fall back to reading */
+		return 0;
+	}
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	in->map = map;
+	in->map_size = st.st_size;
+	rom_stats_count(ROM_STAT_BYTES_MAPPED, st.st_size);
+	return 0;
+}
+
+off_t
+rom_input_remaining(struct rom_input const *in)
+{
+	if (in->size < 0)
+	{
+		return -1;
+	}
+	return (in->pos < in->size) ? in->size - in->pos : 0;
+}
+
+size_t
+rom_input_read(struct rom_input *in, unsigned char const **data,
+               size_t length)
+{
+	struct rom_timer timer;
+	size_t done = 0;
+	ssize_t got;
+
+	if (in->map != NULL)
+	{
+		if (in->pos >= in->map_size)
+		{
+			return 0;
+		}
+		if ((off_t)length > in->map_size - in->pos)
+		{
+			length = in->map_size - in->pos;
+		}
+		*data = in->map + in->pos;
+		in->pos += length;
+		rom_stats_count(ROM_STAT_BYTES_READ, length);
+		return length;
+	}
+
+	if (grow(&in->buffer, &in->capacity, length) != 0)
+	{
+		return (size_t)-1;
+	}
+	rom_stats_begin(&timer);
+	while (done < length)
+	{
+		got = read(in->fd, in->buffer + done, length - done);
+		rom_stats_count(ROM_STAT_READ_CALLS, 1);
+		if (got == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (got == -1)
+		{
+			rom_stats_end(&timer, ROM_PHASE_READ);
+			return (size_t)-1;
+		}
+		if (got == 0)
+		{
+			break;
+		}
+		done += got;
+	}
+	rom_stats_end(&timer, ROM_PHASE_READ);
+	rom_stats_count(ROM_STAT_BYTES_READ, done);
+	*data = in->buffer;
+	in->pos += done;
+	return done;
+}
+
+int
+rom_input_seek(struct rom_input *in, off_t pos)
+{
+	if (in->map == NULL)
+	{
+		rom_stats_count(ROM_STAT_SEEK_CALLS, 1);
+		if (lseek(in->fd, pos, SEEK_SET) == -1)
+		{
+			return -1;
+		}
+	}
+	in->pos = pos;
+	return 0;
+}
+
+void
+rom_input_close(struct rom_input *in)
+{
+	if (in->map != NULL)
+	{
+		munmap(in->map, in->map_size);
+	}
+	free(in->buffer);
+	in->map = NULL;
+	in->buffer = NULL;
+}
+
+
+/* The space is reserved with posix_fallocate where the filesystem
+ * supports it, and by extending the file otherwise.  Mapping starts
+ * on a page boundary, so the map may begin a little before `start'.
+ */
+int
+rom_output_open(struct rom_output *out, int fd, off_t start, off_t size)
+{
+	struct rom_timer timer;
+	int status;
+
+	rom_stats_begin(&timer);
+	status = open_output(out, fd, start, size);
+	rom_stats_end(&timer, ROM_PHASE_OPEN);
+	return status;
+}
+
+static int
+open_output(struct rom_output *out, int fd, off_t start, off_t size)
+{
+	struct stat st;
+	long page = sysconf(_SC_PAGESIZE);
+	void *map;
+	int error;
+
+	memset(out, 0, sizeof(*out));
+	out->fd = fd;
+	out->buffer_size = OUTPUT_BUFFER_SIZE;
+	if (start < 0)
+	{
+		start = lseek(fd, 0, SEEK_CUR);
+		rom_stats_count(ROM_STAT_SEEK_CALLS, 1);
+	}
+	out->start = start;
+	out->size = size;
+	if (size <= 0 || start < 0 || (off_t)(size_t)size != size
+	    || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+	{
+		return 0;
+	}
+	error = posix_fallocate(fd, start, size);
+	if (error == ENOSPC)
+	{
+		errno = error;
+		return -1;
+	}
+	if (error != 0 && st.st_size < start + size
+	    && ftruncate(fd, start + size) != 0)
+	{
+		return 0;
+	}
+	out->map_adjust = (page > 0) ? start % page : 0;
+	map = mmap(NULL, out->map_adjust + size, PROT_READ | PROT_WRITE,
+	           MAP_SHARED, fd, start - out->map_adjust);
+	if (map == MAP_FAILED)
+	{
+		/* an output opened write-only cannot be mapped;
+		 * fall back to writing */
+		lseek(fd, start, SEEK_SET);
+		rom_stats_count(ROM_STAT_SEEK_CALLS, 1);
+		return 0;
+	}
+	posix_madvise(map, out->map_adjust + size, POSIX_MADV_SEQUENTIAL);
+	out->map = map;
+	rom_stats_count(ROM_STAT_BYTES_MAPPED, size);
+	return 0;
+}
+
+void
+rom_output_buffer(struct rom_output *out, size_t size)
+{
+	out->buffer_size = size;
+}
+
+unsigned char *
+rom_output_next(struct rom_output *out, size_t length)
+{
+	unsigned char *space;
+
+	if (out->map != NULL)
+	{
+		if ((off_t)length > out->size - out->pos)
+		{
+			errno = EFBIG;
+			return NULL;
+		}
+		space = out->map + out->map_adjust + out->pos;
+		out->pos += length;
+		rom_stats_count(ROM_STAT_BYTES_WRITTEN, length);
+		return space;
+	}
+
+	if (out->fill + length > out->capacity || out->buffer == NULL)
+	{
+		if (flush(out) != 0
+		    || grow(&out->buffer, &out->capacity,
+		            (length < out->buffer_size)
+		            ? out->buffer_size : length) != 0)
+		{
+			return NULL;
+		}
+	}
+	space = out->buffer + out->fill;
+	out->fill += length;
+	out->pos += length;
+	return space;
+}
+
+unsigned char *
+rom_output_map(struct rom_output *out)
+{
+	if (out->map == NULL)
+	{
+		return NULL;
+	}
+	/* the caller now owns all of it */
+	rom_stats_count(ROM_STAT_BYTES_WRITTEN, out->size - out->pos);
+	out->pos = out->size;
+	return out->map + out->map_adjust;
+}
+
+int
+rom_output_write(struct rom_output *out, void const *data, size_t length)
+{
+	unsigned char *space = rom_output_next(out, length);
+
+	if (space == NULL)
+	{
+		return -1;
+	}
+	memcpy(space, data, length);
+	return 0;
+}
+
+int
+rom_output_close(struct rom_output *out)
+{
+	struct rom_timer timer;
+	int status = 0;
+
+	if (out->map != NULL)
+	{
+		rom_stats_begin(&timer);
+		if (munmap(out->map, out->map_adjust + out->size) != 0)
+		{
+			status = -1;
+		}
+		if (out->pos < out->size
+		    && ftruncate(out->fd, out->start + out->pos) != 0)
+		{
+			status = -1;
+		}
+		/* leave the descriptor where writing would have */
+		lseek(out->fd, out->start + out->pos, SEEK_SET);
+		rom_stats_count(ROM_STAT_SEEK_CALLS, 1);
+		rom_stats_end(&timer, ROM_PHASE_WRITE);
+	}
+	else if (flush(out) != 0)
+	{
+		status = -1;
+	}
+	free(out->buffer);
+	out->map = NULL;
+	out->buffer = NULL;
+	return status;
+}
+
+
+/* Make `*buffer' hold at least `size' bytes. */
+static int
+grow(unsigned char **buffer, size_t *capacity, size_t size)
+{
+	unsigned char *more;
+
+	if (size <= *capacity)
+	{
+		return 0;
+	}
+	more = realloc(*buffer, size);
+	if (more == NULL)
+	{
+		return -1;
+	}
+	*buffer = more;
+	*capacity = size;
+	return 0;
+}
+
+static int
+flush(struct rom_output *out)
+{
+	struct rom_timer timer;
+	size_t done = 0;
+	ssize_t put;
+
+	rom_stats_begin(&timer);
+	while (done < out->fill)
+	{
+		put = write(out->fd, out->buffer + done, out->fill - done);
+		rom_stats_count(ROM_STAT_WRITE_CALLS, 1);
+		if (put == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (put == -1)
+		{
+			rom_stats_end(&timer, ROM_PHASE_WRITE);
+			return -1;
+		}
+		done += put;
+		rom_stats_count(ROM_STAT_BYTES_WRITTEN, put);
+	}
+	rom_stats_end(&timer, ROM_PHASE_WRITE);
+	out->fill = 0;
+	return 0;
+}
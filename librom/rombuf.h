@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * rombuf: hand a rom to the kernels as plain memory
+ *
+ * An input that is a regular file is mapped whole, and read by handing
+ * out pointers into the map; anything else (a pipe, a terminal) is read
+ * with read() into a buffer that grows to the largest request.
+ * An output of known size that is a regular file is given its full size
+ * up front and mapped, so that the kernels write straight into it;
+ * anything else is written with write() from a buffer.
+ * Either way, the caller sees a pointer and a length.
+ ****************************************************************************/
+#ifndef ROM_ROMBUF_H
+#define ROM_ROMBUF_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+struct rom_input
+{
+	int fd;
+	/* the whole file, if it could be mapped */
+	unsigned char *map;
+	off_t map_size;
+	/* size of the file, or -1 if not known */
+	off_t size;
+	/* offset of the next byte to hand out */
+	off_t pos;
+	/* what read() returned, if the file is not mapped */
+	unsigned char *buffer;
+	size_t capacity;
+};
+
+struct rom_output
+{
+	int fd;
+	/* bytes [start, start + size) of the file, if it could be mapped */
+	unsigned char *map;
+	size_t map_adjust;
+	off_t start;
+	off_t size;
+	/* bytes handed out so far */
+	off_t pos;
+	/* what is waiting for write(), if the file is not mapped */
+	unsigned char *buffer;
+	size_t capacity;
+	size_t fill;
+	/* how much to collect before calling write() */
+	size_t buffer_size;
+};
+
+/* Prepare to read from `fd', starting at its current position.
+ * Returns 0, or -1 with errno set.  The descriptor is not closed.
+ */
+int rom_input_open(struct rom_input *in, int fd);
+
+/* Number of bytes left to read, or -1 if not known. */
+off_t rom_input_remaining(struct rom_input const *in);
+
+/* Point `*data' at the next `length' bytes, or fewer at the end of the
+ * input, and return how many there are; 0 means the input is done.
+ * Returns (size_t)-1 with errno set on error.  The bytes stay valid
+ * until the next call, or for as long as the input is open if mapped.
+ */
+size_t rom_input_read(struct rom_input *in, unsigned char const **data,
+                      size_t length);
+
+/* Move to absolute offset `pos' in a seekable input.
+ * Returns 0, or -1 with errno set.
+ */
+int rom_input_seek(struct rom_input *in, off_t pos);
+
+void rom_input_close(struct rom_input *in);
+
+/* Prepare to write to `fd' from offset `start' onwards (or its current
+ * position, if `start' is negative), where `size' bytes will be written
+ * if it is not negative.  Running out of space
+ * for them is reported here, with ENOSPC, rather than part way through.
+ * An unmapped output is written at the descriptor's current position.
+ * Returns 0, or -1 with errno set.  The descriptor is not closed.
+ */
+int rom_output_open(struct rom_output *out, int fd, off_t start, off_t size);
+
+/* Collect at most `size' bytes of an unmapped output before writing
+ * them, rather than the default of 256 KiB, so that a caller streaming
+ * to a pipe holds no more than it asks for at a time.  A single request
+ * larger than `size' is still handed out whole.
+ */
+void rom_output_buffer(struct rom_output *out, size_t size);
+
+/* Return space for the next `length' bytes of output, which the caller
+ * fills before the next call.  A mapped output never goes past `size'.
+ * Returns NULL with errno set on error.
+ */
+unsigned char *rom_output_next(struct rom_output *out, size_t length);
+
+/* The start of a mapped output, for callers that fill all `size' bytes
+ * of it themselves, in any order; NULL if the output is not mapped.
+ */
+unsigned char *rom_output_map(struct rom_output *out);
+
+/* Copy `length' bytes to the output.  Returns 0, or -1 with errno set. */
+int rom_output_write(struct rom_output *out, void const *data,
+                     size_t length);
+
+/* Write out whatever is pending, and trim any part of a mapped
+ * output's reserved size that went unused.  Either way, the descriptor
+ * is left just past the last byte written.
+ * Returns 0, or -1 with errno set.
+ */
+int rom_output_close(struct rom_output *out);
+
+#endif
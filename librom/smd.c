@@ -0,0 +1,165 @@
+/*****************************************************************************
+ * smd: the interleaved format of the Super Magic Drive copier
+ * See smd.h for a description of the layout.
+ ****************************************************************************/
+#include <string.h>
+
+#include "smd.h"
+#include "split.h"
+
+#define HALF_BLOCK (ROM_SMD_BLOCK_SIZE / 2)
+
+static size_t encode_block(unsigned char*, unsigned char const*, size_t);
+static size_t decode_block(unsigned char*, unsigned char const*, size_t);
+static void copy_lane(unsigned char * const*, size_t, unsigned, size_t,
+                      unsigned char const*, size_t);
+
+
+size_t
+rom_smd_size(size_t length)
+{
+	size_t tail = length % ROM_SMD_BLOCK_SIZE;
+
+	return length - tail + ((tail > 0) ? HALF_BLOCK + (tail + 1) / 2 : 0);
+}
+
+size_t
+rom_bin_size(size_t length)
+{
+	size_t tail = length % ROM_SMD_BLOCK_SIZE;
+
+	return length - tail + 2 * ((tail < HALF_BLOCK) ? tail : HALF_BLOCK);
+}
+
+/* A final block counts as complete once its even half is full. */
+void
+rom_smd_header(unsigned char *header, size_t size)
+{
+	memset(header, 0, ROM_SMD_HEADER_SIZE);
+	header[0] = (unsigned char)(((size + 1) / 2) / HALF_BLOCK);
+	header[1] = 0x03;
+	header[8] = 0xAA;
+	header[9] = 0xBB;
+	header[10] = 0x06;
+}
+
+
+size_t
+rom_smd_encode(unsigned char *out, unsigned char const *in, size_t length)
+{
+	size_t nread, nwritten = 0;
+
+	for (nread = 0; nread < length; nread += ROM_SMD_BLOCK_SIZE)
+	{
+		nwritten += encode_block(out + nwritten, in + nread,
+		                         (length - nread < ROM_SMD_BLOCK_SIZE)
+		                         ? length - nread : ROM_SMD_BLOCK_SIZE);
+	}
+	return nwritten;
+}
+
+size_t
+rom_smd_decode(unsigned char *out, unsigned char const *in, size_t length)
+{
+	size_t nread, nwritten = 0;
+
+	for (nread = 0; nread < length; nread += ROM_SMD_BLOCK_SIZE)
+	{
+		nwritten += decode_block(out + nwritten, in + nread,
+		                         (length - nread < ROM_SMD_BLOCK_SIZE)
+		                         ? length - nread : ROM_SMD_BLOCK_SIZE);
+	}
+	return nwritten;
+}
+
+
+/* The even bytes of block i are bytes [i * HALF_BLOCK, (i + 1) * HALF_BLOCK)
+ * of lane 0, and the odd bytes the same of lane 1, so every block is two
+ * copies.  A short final block is laid out as rom_smd_decode() would,
+ * with its missing even bytes zero.
+ */
+void
+rom_smd_split(unsigned char * const *pieces, unsigned char const *in,
+              size_t length, size_t bank_size)
+{
+	size_t bank = (bank_size == 0) ? (size_t)-1 : bank_size;
+	size_t nread, block, pos, nodd, neven;
+
+	for (nread = 0; nread < length; nread += ROM_SMD_BLOCK_SIZE)
+	{
+		block = (length - nread < ROM_SMD_BLOCK_SIZE)
+			? length - nread : ROM_SMD_BLOCK_SIZE;
+		nodd = (block < HALF_BLOCK) ? block : HALF_BLOCK;
+		neven = block - nodd;
+		pos = nread / ROM_SMD_BLOCK_SIZE * HALF_BLOCK;
+		copy_lane(pieces, bank, 0, pos, in + nread + HALF_BLOCK, neven);
+		copy_lane(pieces, bank, 0, pos + neven, NULL, nodd - neven);
+		copy_lane(pieces, bank, 1, pos, in + nread, nodd);
+	}
+}
+
+/* Copy `length' bytes from `src' (or zeros, if NULL) to offset `pos' of
+ * lane `lane', which is cut into pieces of `bank' bytes.
+ */
+static void
+copy_lane(unsigned char * const *pieces, size_t bank, unsigned lane,
+          size_t pos, unsigned char const *src, size_t length)
+{
+	unsigned char *dest;
+	size_t n;
+
+	while (length > 0)
+	{
+		dest = pieces[2 * (pos / bank) + lane] + pos % bank;
+		n = bank - pos % bank;
+		n = (n < length) ? n : length;
+		if (src != NULL)
+		{
+			memcpy(dest, src, n);
+			src += n;
+		}
+		else
+		{
+			memset(dest, 0, n);
+		}
+		pos += n;
+		length -= n;
+	}
+}
+
+
+/* A block is a two-lane split of its BIN data with the even lane
+ * second, so the split engine's kernels do the work.
+ * In a short final block, the odd half is padded with zeros and the
+ * even half ends with the data.
+ */
+static size_t
+encode_block(unsigned char *block, unsigned char const *in, size_t length)
+{
+	unsigned char * const halves[2] = {block + HALF_BLOCK, block};
+	size_t nodd = length / 2;
+
+	rom_deinterleave(halves, in, length, 2);
+	memset(block + nodd, 0, HALF_BLOCK - nodd);
+	return HALF_BLOCK + (length - nodd);
+}
+
+/* A short final block yields two bytes for each byte in its first
+ * half, with any even bytes missing from its second half left as zero.
+ */
+static size_t
+decode_block(unsigned char *out, unsigned char const *block, size_t length)
+{
+	unsigned char const * const halves[2] = {block + HALF_BLOCK, block};
+	size_t nodd, neven;
+
+	nodd = (length < HALF_BLOCK) ? length : HALF_BLOCK;
+	neven = length - nodd;
+	rom_interleave(out, halves, 2 * neven, 2);
+	for (; neven < nodd; ++neven)
+	{
+		out[2 * neven] = 0;
+		out[2 * neven + 1] = block[neven];
+	}
+	return 2 * nodd;
+}
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ * smd: the interleaved format of the Super Magic Drive copier
+ *
+ * An SMD file is a header of ROM_SMD_HEADER_SIZE bytes followed by blocks
+ * of ROM_SMD_BLOCK_SIZE bytes.  The first half of each block holds the
+ * odd bytes of the corresponding 16 kB of BIN data, and the second half
+ * holds the even bytes:
+ *
+ *   BIN   0 1 2 3 4 5 ...
+ *   SMD   1 3 5 ... | 0 2 4 ...
+ *
+ * A short final block keeps the same layout, with the odd half padded
+ * with zeros.
+ ****************************************************************************/
+#ifndef ROM_SMD_H
+#define ROM_SMD_H
+
+#include <stddef.h>
+
+#define ROM_SMD_HEADER_SIZE 0x200
+#define ROM_SMD_BLOCK_SIZE  0x4000
+
+/* Number of SMD block bytes made from `length' bytes of BIN data,
+ * and the reverse.
+ */
+size_t rom_smd_size(size_t length);
+size_t rom_bin_size(size_t length);
+
+/* Fill in the header for an SMD file holding `size' bytes of BIN data:
+ * the number of blocks, 0x03, and the signature at offset 8.
+ */
+void rom_smd_header(unsigned char *header, size_t size);
+
+/* Convert `length' bytes of BIN data at `in' into rom_smd_size(length)
+ * bytes of SMD blocks at `out', or `length' bytes of SMD blocks
+ * into rom_bin_size(length) bytes of BIN data.  Neither header is
+ * included, and the buffers must not overlap.
+ * Each returns the number of bytes produced.
+ */
+size_t rom_smd_encode(unsigned char *out, unsigned char const *in,
+                      size_t length);
+size_t rom_smd_decode(unsigned char *out, unsigned char const *in,
+                      size_t length);
+
+/* Split `length' bytes of SMD blocks at `in' across two byte lanes,
+ * as rom_split_buffer() would split the BIN data they hold, without
+ * converting to BIN first: each half block is already one lane's share.
+ * The pieces are sized for a rom of rom_bin_size(length) bytes.
+ */
+void rom_smd_split(unsigned char * const *pieces, unsigned char const *in,
+                   size_t length, size_t bank_size);
+
+#endif
@@ -0,0 +1,857 @@
+/*****************************************************************************
+ * split: divide a rom among several EPROMs, and put it back together
+ * See split.h for a description of the layout.
+ ****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "kernel.h"
+#include "rombuf.h"
+#include "split.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/* bytes of each lane handled per read */
+#define CHUNK_SIZE 0x10000
+
+/* Kernels move `units' complete units of `lanes' bytes.
+ * Each lane count with a kernel of its own is listed here;
+ * any other lane count uses the generic loops.
+ */
+typedef void (*split_kernel)(unsigned char * const*, unsigned char const*,
+                             size_t);
+typedef void (*join_kernel)(unsigned char*, unsigned char const * const*,
+                            size_t);
+
+static split_kernel select_split_kernel(unsigned);
+static join_kernel select_join_kernel(unsigned);
+static void split_generic(unsigned char * const*, unsigned char const*,
+                          size_t, unsigned);
+static void join_generic(unsigned char*, unsigned char const * const*,
+                         size_t, unsigned);
+static void split1(unsigned char * const*, unsigned char const*, size_t);
+static void join1(unsigned char*, unsigned char const * const*, size_t);
+static void split2_scalar(unsigned char * const*, unsigned char const*, size_t);
+static void join2_scalar(unsigned char*, unsigned char const * const*, size_t);
+static void split4_scalar(unsigned char * const*, unsigned char const*, size_t);
+static void join4_scalar(unsigned char*, unsigned char const * const*, size_t);
+#ifdef HAVE_X86_KERNELS
+static void split2_sse2(unsigned char * const*, unsigned char const*, size_t);
+static void split2_avx2(unsigned char * const*, unsigned char const*, size_t);
+static void join2_sse2(unsigned char*, unsigned char const * const*, size_t);
+static void join2_avx2(unsigned char*, unsigned char const * const*, size_t);
+static void split4_sse2(unsigned char * const*, unsigned char const*, size_t);
+static void join4_sse2(unsigned char*, unsigned char const * const*, size_t);
+#endif
+static int grow_pieces(int**, struct rom_output**, unsigned long);
+static int open_output(int*, struct rom_output*, unsigned long,
+                       rom_piece_opener, void*, off_t);
+static int close_output(int, struct rom_output*);
+static int close_inputs(int*, struct rom_input*, unsigned);
+
+
+size_t
+rom_lane_length(size_t length, unsigned lanes, unsigned lane)
+{
+	return (length + lanes - 1 - lane) / lanes;
+}
+
+unsigned long
+rom_split_pieces(off_t size, unsigned lanes, size_t bank_size)
+{
+	off_t window = (off_t)lanes * bank_size;
+
+	if (bank_size == 0)
+	{
+		return lanes;
+	}
+	return lanes * (unsigned long)((size + window - 1) / window);
+}
+
+off_t
+rom_piece_size(off_t size, unsigned lanes, size_t bank_size,
+               unsigned long piece)
+{
+	off_t window = (off_t)lanes * bank_size;
+	off_t start;
+
+	if (bank_size == 0)
+	{
+		return rom_lane_length(size, lanes, piece);
+	}
+	start = (off_t)(piece / lanes) * window;
+	if (start >= size)
+	{
+		return 0;
+	}
+	return rom_lane_length((size - start < window) ? size - start : window,
+	                       lanes, piece % lanes);
+}
+
+
+void
+rom_deinterleave(unsigned char * const *out, unsigned char const *in,
+                 size_t length, unsigned lanes)
+{
+	split_kernel kernel = select_split_kernel(lanes);
+	size_t units = length / lanes;
+	unsigned k;
+
+	if (kernel == NULL)
+	{
+		split_generic(out, in, length, lanes);
+		return;
+	}
+	kernel(out, in, units);
+	for (k = 0; k < length % lanes; ++k)
+	{
+		out[k][units] = in[units * lanes + k];
+	}
+}
+
+void
+rom_interleave(unsigned char *out, unsigned char const * const *in,
+               size_t length, unsigned lanes)
+{
+	join_kernel kernel = select_join_kernel(lanes);
+	size_t units = length / lanes;
+	unsigned k;
+
+	if (kernel == NULL)
+	{
+		join_generic(out, in, length, lanes);
+		return;
+	}
+	kernel(out, in, units);
+	for (k = 0; k < length % lanes; ++k)
+	{
+		out[units * lanes + k] = in[k][units];
+	}
+}
+
+
+void
+rom_split_buffer(unsigned char * const *pieces, unsigned char const *in,
+                 size_t length, unsigned lanes, size_t bank_size)
+{
+	size_t window = (bank_size == 0) ? length : lanes * bank_size;
+	size_t start;
+
+	for (start = 0; start < length; start += window, pieces += lanes)
+	{
+		rom_deinterleave(pieces, in + start,
+		                 (length - start < window) ? length - start : window,
+		                 lanes);
+	}
+}
+
+void
+rom_join_buffer(unsigned char *out, unsigned char const * const *pieces,
+                size_t length, unsigned lanes, size_t bank_size)
+{
+	size_t window = (bank_size == 0) ? length : lanes * bank_size;
+	size_t start;
+
+	for (start = 0; start < length; start += window, pieces += lanes)
+	{
+		rom_interleave(out + start, pieces,
+		               (length - start < window) ? length - start : window,
+		               lanes);
+	}
+}
+
+
+/* The input is read in steps of up to CHUNK_SIZE units that never cross
+ * a bank, and each lane's share of a step is deinterleaved straight into
+ * its piece.  If the size of the input is known, every piece is opened
+ * and given its full size before anything is written, so that running
+ * out of space is noticed up front, and mapped where possible;
+ * otherwise pieces are opened as their banks are reached.
+ * Each bank's pieces are finished as soon as the next bank starts.
+ */
+int
+rom_split_fd(int ifd, unsigned lanes, size_t bank_size,
+             rom_piece_opener open_piece, void *context)
+{
+	struct rom_input in;
+	struct rom_output *outs = NULL;
+	int *fds = NULL;
+	unsigned char *dest[ROM_MAX_LANES];
+	unsigned char const *data;
+	unsigned long opened = 0, closed = 0, bank = 0, p;
+	off_t size, pos = 0, offset;
+	size_t step, n;
+	unsigned k;
+	int status = -1;
+	int saved;
+
+	if (lanes < 1 || lanes > ROM_MAX_LANES)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	rom_input_open(&in, ifd);
+	size = rom_input_remaining(&in);
+	if (size >= 0)
+	{
+		if (grow_pieces(&fds, &outs, rom_split_pieces(size, lanes, bank_size))
+		    != 0)
+		{
+			goto done;
+		}
+		for (p = 0; p < rom_split_pieces(size, lanes, bank_size); ++p)
+		{
+			if (open_output(fds, outs, p, open_piece, context,
+			                rom_piece_size(size, lanes, bank_size, p)) != 0)
+			{
+				goto done;
+			}
+			opened = p + 1;
+		}
+	}
+
+	for (;;)
+	{
+		step = CHUNK_SIZE;
+		if (bank_size != 0)
+		{
+			bank = pos / ((off_t)lanes * bank_size);
+			offset = (pos % ((off_t)lanes * bank_size)) / lanes;
+			if (bank_size - offset < step)
+			{
+				step = bank_size - offset;
+			}
+		}
+		n = rom_input_read(&in, &data, step * lanes);
+		if (n == (size_t)-1)
+		{
+			goto done;
+		}
+		if (n == 0)
+		{
+			break;
+		}
+		if ((bank + 1) * lanes > opened)
+		{
+			/* the size was unknown, or the input has grown */
+			if (grow_pieces(&fds, &outs, (bank + 1) * lanes) != 0)
+			{
+				goto done;
+			}
+			for (p = opened; p < (bank + 1) * lanes; ++p)
+			{
+				if (open_output(fds, outs, p, open_piece, context, -1) != 0)
+				{
+					goto done;
+				}
+				opened = p + 1;
+			}
+		}
+		for (; closed < bank * lanes; ++closed)
+		{
+			if (close_output(fds[closed], outs + closed) != 0)
+			{
+				++closed;
+				goto done;
+			}
+		}
+		for (k = 0; k < lanes; ++k)
+		{
+			dest[k] = rom_output_next(outs + bank * lanes + k,
+			                          rom_lane_length(n, lanes, k));
+			if (dest[k] == NULL)
+			{
+				goto done;
+			}
+		}
+		rom_deinterleave(dest, data, n, lanes);
+		pos += n;
+		if (n < step * lanes)
+		{
+			break;
+		}
+	}
+	status = 0;
+
+done:
+	saved = errno;
+	for (; closed < opened; ++closed)
+	{
+		if (close_output(fds[closed], outs + closed) != 0 && status == 0)
+		{
+			saved = errno;
+			status = -1;
+		}
+	}
+	free(fds);
+	free(outs);
+	rom_input_close(&in);
+	errno = saved;
+	return status;
+}
+
+
+/* Banks are joined in order until the first piece of a bank is missing.
+ * Within a bank, each lane must hold as many bytes as the one below it,
+ * or one fewer; the first bank that comes up short is the last.
+ * When the pieces of a bank are regular files, the size of its part of
+ * the output is known, and that part is mapped where possible.
+ */
+int
+rom_join_fd(int ofd, unsigned lanes, size_t bank_size,
+            rom_piece_opener open_piece, void *context)
+{
+	struct rom_input ins[ROM_MAX_LANES];
+	struct rom_output out;
+	unsigned char const *data[ROM_MAX_LANES];
+	unsigned char *dest;
+	int fds[ROM_MAX_LANES];
+	size_t got[ROM_MAX_LANES];
+	unsigned long bank;
+	size_t want, offset, total;
+	off_t start, length, remaining;
+	unsigned k, nopen = 0;
+	int last = 0;
+	int status = -1;
+	int saved;
+
+	if (lanes < 1 || lanes > ROM_MAX_LANES)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	start = lseek(ofd, 0, SEEK_CUR);
+	if (start == -1)
+	{
+		start = 0;
+	}
+
+	for (bank = 0; !last; ++bank)
+	{
+		for (nopen = 0; nopen < lanes; ++nopen)
+		{
+			fds[nopen] = open_piece(context, bank * lanes + nopen);
+			if (fds[nopen] == -1)
+			{
+				if (nopen == 0 && bank > 0 && errno == ENOENT)
+				{
+					status = 0;
+				}
+				goto done;
+			}
+			rom_input_open(ins + nopen, fds[nopen]);
+		}
+
+		length = 0;
+		for (k = 0; k < lanes && length >= 0; ++k)
+		{
+			remaining = rom_input_remaining(ins + k);
+			if (bank_size != 0 && remaining > (off_t)bank_size)
+			{
+				remaining = bank_size;
+			}
+			length = (remaining < 0) ? -1 : length + remaining;
+		}
+		if (rom_output_open(&out, ofd, start, length) != 0)
+		{
+			goto done;
+		}
+
+		for (offset = 0; bank_size == 0 || offset < bank_size; offset += want)
+		{
+			want = CHUNK_SIZE;
+			if (bank_size != 0 && bank_size - offset < want)
+			{
+				want = bank_size - offset;
+			}
+			total = 0;
+			for (k = 0; k < lanes; ++k)
+			{
+				got[k] = rom_input_read(ins + k, data + k, want);
+				if (got[k] == (size_t)-1)
+				{
+					goto fail;
+				}
+				if (k > 0 && (got[k] > got[k - 1] || got[k] + 1 < got[0]))
+				{
+					errno = EINVAL;
+					goto fail;
+				}
+				total += got[k];
+			}
+			dest = rom_output_next(&out, total);
+			if (dest == NULL)
+			{
+				goto fail;
+			}
+			rom_interleave(dest, data, total, lanes);
+			if (got[lanes - 1] < want)
+			{
+				last = 1;
+				break;
+			}
+		}
+		start += out.pos;
+		if (rom_output_close(&out) != 0)
+		{
+			goto done;
+		}
+		if (close_inputs(fds, ins, nopen) != 0)
+		{
+			nopen = 0;
+			goto done;
+		}
+		nopen = 0;
+		if (bank_size == 0)
+		{
+			break;
+		}
+	}
+	status = 0;
+	goto done;
+
+fail:
+	saved = errno;
+	rom_output_close(&out);
+	errno = saved;
+done:
+	saved = errno;
+	close_inputs(fds, ins, nopen);
+	errno = saved;
+	return status;
+}
+
+
+/* Make room for `n' pieces. */
+static int
+grow_pieces(int **fds, struct rom_output **outs, unsigned long n)
+{
+	int *more_fds;
+	struct rom_output *more_outs;
+
+	more_fds = realloc(*fds, (n + 1) * sizeof(**fds));
+	if (more_fds == NULL)
+	{
+		return -1;
+	}
+	*fds = more_fds;
+	more_outs = realloc(*outs, (n + 1) * sizeof(**outs));
+	if (more_outs == NULL)
+	{
+		return -1;
+	}
+	*outs = more_outs;
+	return 0;
+}
+
+/* Open piece `p' for output, expecting `size' bytes if not negative. */
+static int
+open_output(int *fds, struct rom_output *outs, unsigned long p,
+            rom_piece_opener open_piece, void *context, off_t size)
+{
+	int saved;
+
+	fds[p] = open_piece(context, p);
+	if (fds[p] == -1)
+	{
+		return -1;
+	}
+	if (rom_output_open(outs + p, fds[p], 0, size) != 0)
+	{
+		saved = errno;
+		close(fds[p]);
+		errno = saved;
+		return -1;
+	}
+	return 0;
+}
+
+static int
+close_output(int fd, struct rom_output *out)
+{
+	int status = rom_output_close(out);
+
+	if (close(fd) != 0)
+	{
+		status = -1;
+	}
+	return status;
+}
+
+static int
+close_inputs(int *fds, struct rom_input *ins, unsigned n)
+{
+	unsigned k;
+	int status = 0;
+
+	for (k = 0; k < n; ++k)
+	{
+		rom_input_close(ins + k);
+		if (close(fds[k]) != 0)
+		{
+			status = -1;
+		}
+	}
+	return status;
+}
+
+
+/* Kernel selection, by lane count and by the kernel level in use
+ * (see kernel.h).  Lane counts without a kernel of their own get NULL.
+ */
+static split_kernel
+select_split_kernel(unsigned lanes)
+{
+	switch (lanes)
+	{
+	case 1:
+		return split1;
+#ifdef HAVE_X86_KERNELS
+	case 2:
+		switch (rom_kernel_level())
+		{
+		case ROM_KERNEL_AVX2:
+			return split2_avx2;
+		case ROM_KERNEL_SSE2:
+			return split2_sse2;
+		default:
+			return split2_scalar;
+		}
+	case 4:
+		return (rom_kernel_level() >= ROM_KERNEL_SSE2)
+			? split4_sse2 : split4_scalar;
+#else
+	case 2:
+		return split2_scalar;
+	case 4:
+		return split4_scalar;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static join_kernel
+select_join_kernel(unsigned lanes)
+{
+	switch (lanes)
+	{
+	case 1:
+		return join1;
+#ifdef HAVE_X86_KERNELS
+	case 2:
+		switch (rom_kernel_level())
+		{
+		case ROM_KERNEL_AVX2:
+			return join2_avx2;
+		case ROM_KERNEL_SSE2:
+			return join2_sse2;
+		default:
+			return join2_scalar;
+		}
+	case 4:
+		return (rom_kernel_level() >= ROM_KERNEL_SSE2)
+			? join4_sse2 : join4_scalar;
+#else
+	case 2:
+		return join2_scalar;
+	case 4:
+		return join4_scalar;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+
+static void
+split_generic(unsigned char * const *out, unsigned char const *in,
+              size_t length, unsigned lanes)
+{
+	unsigned char *o;
+	size_t i;
+	unsigned k;
+
+	for (k = 0; k < lanes; ++k)
+	{
+		o = out[k];
+		for (i = k; i < length; i += lanes)
+		{
+			*o++ = in[i];
+		}
+	}
+}
+
+static void
+join_generic(unsigned char *out, unsigned char const * const *in,
+             size_t length, unsigned lanes)
+{
+	unsigned char const *p;
+	size_t i;
+	unsigned k;
+
+	for (k = 0; k < lanes; ++k)
+	{
+		p = in[k];
+		for (i = k; i < length; i += lanes)
+		{
+			out[i] = *p++;
+		}
+	}
+}
+
+static void
+split1(unsigned char * const *out, unsigned char const *in, size_t units)
+{
+	memcpy(out[0], in, units);
+}
+
+static void
+join1(unsigned char *out, unsigned char const * const *in, size_t units)
+{
+	memcpy(out, in[0], units);
+}
+
+static void
+split2_scalar(unsigned char * const *out, unsigned char const *in,
+              size_t units)
+{
+	size_t i;
+
+	for (i = 0; i < units; ++i)
+	{
+		out[0][i] = in[2 * i];
+		out[1][i] = in[2 * i + 1];
+	}
+}
+
+static void
+join2_scalar(unsigned char *out, unsigned char const * const *in,
+             size_t units)
+{
+	size_t i;
+
+	for (i = 0; i < units; ++i)
+	{
+		out[2 * i] = in[0][i];
+		out[2 * i + 1] = in[1][i];
+	}
+}
+
+static void
+split4_scalar(unsigned char * const *out, unsigned char const *in,
+              size_t units)
+{
+	size_t i;
+
+	for (i = 0; i < units; ++i)
+	{
+		out[0][i] = in[4 * i];
+		out[1][i] = in[4 * i + 1];
+		out[2][i] = in[4 * i + 2];
+		out[3][i] = in[4 * i + 3];
+	}
+}
+
+static void
+join4_scalar(unsigned char *out, unsigned char const * const *in,
+             size_t units)
+{
+	size_t i;
+
+	for (i = 0; i < units; ++i)
+	{
+		out[4 * i] = in[0][i];
+		out[4 * i + 1] = in[1][i];
+		out[4 * i + 2] = in[2][i];
+		out[4 * i + 3] = in[3][i];
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+static void
+split2_sse2(unsigned char * const *out, unsigned char const *in,
+            size_t units)
+{
+	__m128i const mask = _mm_set1_epi16(0x00ff);
+	size_t i;
+
+	for (i = 0; i + 16 <= units; i += 16)
+	{
+		__m128i const a = _mm_loadu_si128((__m128i const *)(in + 2 * i));
+		__m128i const b = _mm_loadu_si128((__m128i const *)(in + 2 * i + 16));
+		_mm_storeu_si128((__m128i *)(out[0] + i),
+		                 _mm_packus_epi16(_mm_and_si128(a, mask),
+		                                  _mm_and_si128(b, mask)));
+		_mm_storeu_si128((__m128i *)(out[1] + i),
+		                 _mm_packus_epi16(_mm_srli_epi16(a, 8),
+		                                  _mm_srli_epi16(b, 8)));
+	}
+	for (; i < units; ++i)
+	{
+		out[0][i] = in[2 * i];
+		out[1][i] = in[2 * i + 1];
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+split2_avx2(unsigned char * const *out, unsigned char const *in,
+            size_t units)
+{
+	__m256i const mask = _mm256_set1_epi16(0x00ff);
+	size_t i;
+
+	for (i = 0; i + 32 <= units; i += 32)
+	{
+		__m256i const a = _mm256_loadu_si256((__m256i const *)(in + 2 * i));
+		__m256i const b = _mm256_loadu_si256((__m256i const *)(in + 2 * i + 32));
+		/* packing works within 128-bit lanes, so put the quarters back
+		 * in order afterwards */
+		__m256i const e = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+		                                      _mm256_and_si256(b, mask));
+		__m256i const o = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+		                                      _mm256_srli_epi16(b, 8));
+		_mm256_storeu_si256((__m256i *)(out[0] + i),
+		                    _mm256_permute4x64_epi64(e, 0xd8));
+		_mm256_storeu_si256((__m256i *)(out[1] + i),
+		                    _mm256_permute4x64_epi64(o, 0xd8));
+	}
+	for (; i < units; ++i)
+	{
+		out[0][i] = in[2 * i];
+		out[1][i] = in[2 * i + 1];
+	}
+}
+
+__attribute__((target("sse2")))
+static void
+join2_sse2(unsigned char *out, unsigned char const * const *in,
+           size_t units)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= units; i += 16)
+	{
+		__m128i const e = _mm_loadu_si128((__m128i const *)(in[0] + i));
+		__m128i const o = _mm_loadu_si128((__m128i const *)(in[1] + i));
+		_mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi8(e, o));
+		_mm_storeu_si128((__m128i *)(out + 2 * i + 16),
+		                 _mm_unpackhi_epi8(e, o));
+	}
+	for (; i < units; ++i)
+	{
+		out[2 * i] = in[0][i];
+		out[2 * i + 1] = in[1][i];
+	}
+}
+
+__attribute__((target("avx2")))
+static void
+join2_avx2(unsigned char *out, unsigned char const * const *in,
+           size_t units)
+{
+	size_t i;
+
+	for (i = 0; i + 32 <= units; i += 32)
+	{
+		__m256i const e = _mm256_loadu_si256((__m256i const *)(in[0] + i));
+		__m256i const o = _mm256_loadu_si256((__m256i const *)(in[1] + i));
+		/* unpacking works within 128-bit lanes, so put the lanes back
+		 * in order afterwards */
+		__m256i const lo = _mm256_unpacklo_epi8(e, o);
+		__m256i const hi = _mm256_unpackhi_epi8(e, o);
+		_mm256_storeu_si256((__m256i *)(out + 2 * i),
+		                    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(out + 2 * i + 32),
+		                    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	for (; i < units; ++i)
+	{
+		out[2 * i] = in[0][i];
+		out[2 * i + 1] = in[1][i];
+	}
+}
+
+/* A four-way split is two rounds of two-way splitting:
+ * the even bytes hold lanes 0 and 2, and the odd bytes lanes 1 and 3.
+ */
+__attribute__((target("sse2")))
+static void
+split4_sse2(unsigned char * const *out, unsigned char const *in,
+            size_t units)
+{
+	__m128i const mask = _mm_set1_epi16(0x00ff);
+	size_t i;
+
+	for (i = 0; i + 16 <= units; i += 16)
+	{
+		__m128i const a = _mm_loadu_si128((__m128i const *)(in + 4 * i));
+		__m128i const b = _mm_loadu_si128((__m128i const *)(in + 4 * i + 16));
+		__m128i const c = _mm_loadu_si128((__m128i const *)(in + 4 * i + 32));
+		__m128i const d = _mm_loadu_si128((__m128i const *)(in + 4 * i + 48));
+		__m128i const e1 = _mm_packus_epi16(_mm_and_si128(a, mask),
+		                                    _mm_and_si128(b, mask));
+		__m128i const e2 = _mm_packus_epi16(_mm_and_si128(c, mask),
+		                                    _mm_and_si128(d, mask));
+		__m128i const o1 = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+		                                    _mm_srli_epi16(b, 8));
+		__m128i const o2 = _mm_packus_epi16(_mm_srli_epi16(c, 8),
+		                                    _mm_srli_epi16(d, 8));
+		_mm_storeu_si128((__m128i *)(out[0] + i),
+		                 _mm_packus_epi16(_mm_and_si128(e1, mask),
+		                                  _mm_and_si128(e2, mask)));
+		_mm_storeu_si128((__m128i *)(out[2] + i),
+		                 _mm_packus_epi16(_mm_srli_epi16(e1, 8),
+		                                  _mm_srli_epi16(e2, 8)));
+		_mm_storeu_si128((__m128i *)(out[1] + i),
+		                 _mm_packus_epi16(_mm_and_si128(o1, mask),
+		                                  _mm_and_si128(o2, mask)));
+		_mm_storeu_si128((__m128i *)(out[3] + i),
+		                 _mm_packus_epi16(_mm_srli_epi16(o1, 8),
+		                                  _mm_srli_epi16(o2, 8)));
+	}
+	split4_scalar((unsigned char * const[]){out[0] + i, out[1] + i,
+	                                        out[2] + i, out[3] + i},
+	              in + 4 * i, units - i);
+}
+
+__attribute__((target("sse2")))
+static void
+join4_sse2(unsigned char *out, unsigned char const * const *in,
+           size_t units)
+{
+	size_t i;
+
+	for (i = 0; i + 16 <= units; i += 16)
+	{
+		__m128i const l0 = _mm_loadu_si128((__m128i const *)(in[0] + i));
+		__m128i const l1 = _mm_loadu_si128((__m128i const *)(in[1] + i));
+		__m128i const l2 = _mm_loadu_si128((__m128i const *)(in[2] + i));
+		__m128i const l3 = _mm_loadu_si128((__m128i const *)(in[3] + i));
+		__m128i const p01lo = _mm_unpacklo_epi8(l0, l1);
+		__m128i const p01hi = _mm_unpackhi_epi8(l0, l1);
+		__m128i const p23lo = _mm_unpacklo_epi8(l2, l3);
+		__m128i const p23hi = _mm_unpackhi_epi8(l2, l3);
+		_mm_storeu_si128((__m128i *)(out + 4 * i),
+		                 _mm_unpacklo_epi16(p01lo, p23lo));
+		_mm_storeu_si128((__m128i *)(out + 4 * i + 16),
+		                 _mm_unpackhi_epi16(p01lo, p23lo));
+		_mm_storeu_si128((__m128i *)(out + 4 * i + 32),
+		                 _mm_unpacklo_epi16(p01hi, p23hi));
+		_mm_storeu_si128((__m128i *)(out + 4 * i + 48),
+		                 _mm_unpackhi_epi16(p01hi, p23hi));
+	}
+	join4_scalar(out + 4 * i,
+	             (unsigned char const * const[]){in[0] + i, in[1] + i,
+	                                             in[2] + i, in[3] + i},
+	             units - i);
+}
+#endif
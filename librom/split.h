@@ -0,0 +1,73 @@
+/*****************************************************************************
+ * split: divide a rom among several EPROMs, and put it back together
+ *
+ * A rom is split into `lanes' byte lanes: byte i belongs to lane i % lanes.
+ * Each lane is then cut into banks of `bank_size' bytes, or left whole if
+ * `bank_size' is zero.  The pieces are numbered bank by bank, so that
+ * piece (bank * lanes + lane) holds that lane's part of that bank:
+ *
+ *   lanes = 2, bank_size = 128 kB    (s128k)
+ *   +---------+---------+
+ *   | 0: Even | 1: Odd  |   first 256 kB of the rom
+ *   +---------+---------+
+ *   | 2: Even | 3: Odd  |   next 256 kB
+ *   +---------+---------+
+ *
+ *   lanes = 2, bank_size = 0         (bin2hilo, hilo2bin)
+ *   lanes = 4, bank_size = 512 kB    (32-bit test rigs)
+ *
+ * If a bank does not divide evenly, its lower lanes get one byte more.
+ ****************************************************************************/
+#ifndef ROM_SPLIT_H
+#define ROM_SPLIT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define ROM_MAX_LANES 16
+
+/* Called to open piece number `piece'.
+ * Returns a file descriptor, or -1 with errno set.
+ * When joining, failing with ENOENT at the start of a bank
+ * marks the end of the rom.
+ */
+typedef int (*rom_piece_opener)(void *context, unsigned long piece);
+
+/* Number of bytes of a `length'-byte rom that fall in `lane'. */
+size_t rom_lane_length(size_t length, unsigned lanes, unsigned lane);
+
+/* Number of pieces a `size'-byte rom is split into,
+ * and the size of piece number `piece'.
+ */
+unsigned long rom_split_pieces(off_t size, unsigned lanes, size_t bank_size);
+off_t rom_piece_size(off_t size, unsigned lanes, size_t bank_size,
+                     unsigned long piece);
+
+/* Distribute `length' bytes of `in' among the `lanes' buffers of `out',
+ * and the reverse.
+ */
+void rom_deinterleave(unsigned char * const *out, unsigned char const *in,
+                      size_t length, unsigned lanes);
+void rom_interleave(unsigned char *out, unsigned char const * const *in,
+                    size_t length, unsigned lanes);
+
+/* Split the `length'-byte rom at `in' into the caller's buffers `pieces',
+ * one for each of the rom_split_pieces() pieces and each holding at least
+ * rom_piece_size() bytes; or join such pieces into the rom at `out'.
+ */
+void rom_split_buffer(unsigned char * const *pieces, unsigned char const *in,
+                      size_t length, unsigned lanes, size_t bank_size);
+void rom_join_buffer(unsigned char *out, unsigned char const * const *pieces,
+                     size_t length, unsigned lanes, size_t bank_size);
+
+/* Split the rom read from `ifd' into pieces opened by `open_piece',
+ * or join the pieces opened by `open_piece' into a rom written to `ofd'.
+ * All pieces are closed before returning.
+ * Each returns 0 on success, or -1 with errno set.
+ */
+int rom_split_fd(int ifd, unsigned lanes, size_t bank_size,
+                 rom_piece_opener open_piece, void *context);
+int rom_join_fd(int ofd, unsigned lanes, size_t bank_size,
+                rom_piece_opener open_piece, void *context);
+
+#endif
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * stats: where a tool spent its time, for a job runner to collect
+ * See stats.h for what is collected.
+ ****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+/* the counters are shared by every thread */
+#if defined(__GNUC__)
+#define ADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#else
+#define ADD(p, n) (*(p) += (n))
+#endif
+
+int rom_stats_on = 0;
+
+static char const *tool;
+/* a copy of stderr, so that a tool may close its own */
+static FILE *out;
+static struct timespec started;
+static uint64_t counters[ROM_COUNTERS];
+/* nanoseconds of wall-clock and CPU time in each phase */
+static uint64_t phase_wall[ROM_PHASES];
+static uint64_t phase_cpu[ROM_PHASES];
+static char const * const phase_names[ROM_PHASES] = {
+	"open", "read", "write", "fsync"
+};
+
+static void print_stats(void);
+static uint64_t elapsed(struct timespec const*, struct timespec const*);
+static double seconds(uint64_t);
+
+
+void
+rom_stats_start(char const *name)
+{
+	char const *env = getenv("ROM_STATS");
+	char const *slash = strrchr(name, '/');
+	int fd;
+
+	if (rom_stats_on || env == NULL || *env == '\0' || strcmp(env, "0") == 0)
+	{
+		return;
+	}
+	tool = (slash == NULL) ? name : slash + 1;
+	fd = dup(STDERR_FILENO);
+	if (fd == -1 || (out = fdopen(fd, "w")) == NULL)
+	{
+		if (fd != -1)
+		{
+			close(fd);
+		}
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	if (atexit(print_stats) == 0)
+	{
+		rom_stats_on = 1;
+	}
+}
+
+void
+rom_stats_begin(struct rom_timer *timer)
+{
+	if (!rom_stats_on)
+	{
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timer->cpu);
+}
+
+void
+rom_stats_end(struct rom_timer const *timer, enum rom_phase phase)
+{
+	struct timespec wall, cpu;
+
+	if (!rom_stats_on)
+	{
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	ADD(&phase_wall[phase], elapsed(&timer->wall, &wall));
+	ADD(&phase_cpu[phase], elapsed(&timer->cpu, &cpu));
+}
+
+void
+rom_stats_count(enum rom_counter counter, uint64_t n)
+{
+	if (rom_stats_on)
+	{
+		ADD(&counters[counter], n);
+	}
+}
+
+
+/* Transform is the time not spent in any other phase.  With several
+ * threads the phases overlap, so that share of the wall-clock time is
+ * only a lower bound.
+ */
+static void
+print_stats(void)
+{
+	struct timespec now;
+	struct rusage usage;
+	uint64_t wall, cpu = 0, other_wall = 0, other_cpu = 0;
+	long rss = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wall = elapsed(&started, &now);
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		cpu = (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+			* 1000000000
+			+ (uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)
+			* 1000;
+		rss = usage.ru_maxrss;
+	}
+	for (i = 0; i < ROM_PHASES; ++i)
+	{
+		other_wall += phase_wall[i];
+		other_cpu += phase_cpu[i];
+	}
+
+	fprintf(out, "{\"tool\":\"%s\",\"wall_s\":%.6f,\"cpu_s\":%.6f,"
+	        "\"phases\":{", tool, seconds(wall), seconds(cpu));
+	for (i = 0; i < ROM_PHASES; ++i)
+	{
+		fprintf(out, "%s\"%s\":{\"wall_s\":%.6f,\"cpu_s\":%.6f}",
+		        (i == 0) ? "" : ",", phase_names[i],
+		        seconds(phase_wall[i]), seconds(phase_cpu[i]));
+		if (i == ROM_PHASE_READ)
+		{
+			fprintf(out, ",\"transform\":{\"wall_s\":%.6f,"
+			        "\"cpu_s\":%.6f}",
+			        seconds((wall > other_wall) ? wall - other_wall : 0),
+			        seconds((cpu > other_cpu) ? cpu - other_cpu : 0));
+		}
+	}
+	fprintf(out, "},");
+	fprintf(out, "\"bytes_read\":%llu,\"bytes_written\":%llu,"
+	        "\"bytes_mapped\":%llu,\"read_calls\":%llu,"
+	        "\"write_calls\":%llu,\"seek_calls\":%llu,"
+	        "\"peak_rss_kb\":%ld,\"read_mb_per_s\":%.1f,"
+	        "\"write_mb_per_s\":%.1f}\n",
+	        (unsigned long long)counters[ROM_STAT_BYTES_READ],
+	        (unsigned long long)counters[ROM_STAT_BYTES_WRITTEN],
+	        (unsigned long long)counters[ROM_STAT_BYTES_MAPPED],
+	        (unsigned long long)counters[ROM_STAT_READ_CALLS],
+	        (unsigned long long)counters[ROM_STAT_WRITE_CALLS],
+	        (unsigned long long)counters[ROM_STAT_SEEK_CALLS],
+	        rss,
+	        wall ? counters[ROM_STAT_BYTES_READ] / seconds(wall) / 1e6 : 0.0,
+	        wall ? counters[ROM_STAT_BYTES_WRITTEN] / seconds(wall) / 1e6
+	        : 0.0);
+	fclose(out);
+}
+
+static uint64_t
+elapsed(struct timespec const *from, struct timespec const *to)
+{
+	int64_t ns = (int64_t)(to->tv_sec - from->tv_sec) * 1000000000
+		+ (to->tv_nsec - from->tv_nsec);
+
+	return (ns > 0) ? (uint64_t)ns : 0;
+}
+
+static double
+seconds(uint64_t ns)
+{
+	return ns / 1e9;
+}
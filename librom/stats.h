@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * stats: where a tool spent its time, for a job runner to collect
+ *
+ * If the environment variable ROM_STATS is set (to anything but "" or
+ * "0") when a tool calls rom_stats_start(), one JSON object is printed
+ * on standard error as it exits:
+ *   {"tool":"smd2bin","wall_s":...,"cpu_s":...,
+ *    "phases":{"open":{"wall_s":...,"cpu_s":...},"read":{...},
+ *              "transform":{...},"write":{...},"fsync":{...}},
+ *    "bytes_read":...,"bytes_written":...,"bytes_mapped":...,
+ *    "read_calls":...,"write_calls":...,"seek_calls":...,
+ *    "peak_rss_kb":...,"read_mb_per_s":...,"write_mb_per_s":...}
+ * open covers opening, mapping and reserving space; read and write
+ * cover the calls that move data; transform is whatever is left.
+ * Bytes read from or written to a map count as read or written when
+ * they are handed out, though the kernel moves them as pages are
+ * touched, so for a mapped file that time shows up under transform.
+ * Otherwise everything here costs one test of a flag per call.
+ ****************************************************************************/
+#ifndef ROM_STATS_H
+#define ROM_STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+enum rom_phase
+{
+	ROM_PHASE_OPEN,
+	ROM_PHASE_READ,
+	ROM_PHASE_WRITE,
+	ROM_PHASE_FSYNC,
+	ROM_PHASES
+};
+
+enum rom_counter
+{
+	ROM_STAT_BYTES_READ,
+	ROM_STAT_BYTES_WRITTEN,
+	ROM_STAT_BYTES_MAPPED,
+	ROM_STAT_READ_CALLS,
+	ROM_STAT_WRITE_CALLS,
+	ROM_STAT_SEEK_CALLS,
+	ROM_COUNTERS
+};
+
+/* the start of a timed stretch */
+struct rom_timer
+{
+	struct timespec wall;
+	struct timespec cpu;
+};
+
+/* Start collecting, if ROM_STATS asks for it, for the tool `name'. */
+void rom_stats_start(char const *name);
+
+/* Whether stats are being collected. */
+extern int rom_stats_on;
+
+/* Time a stretch of work on this thread as part of `phase'. */
+void rom_stats_begin(struct rom_timer *timer);
+void rom_stats_end(struct rom_timer const *timer, enum rom_phase phase);
+
+/* Add `n' to a counter.  Safe to call from any thread. */
+void rom_stats_count(enum rom_counter counter, uint64_t n);
+
+#endif
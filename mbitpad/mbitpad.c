@@ -8,26 +8,45 @@
 #include <string.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "checksum.h"
+#include "pad.h"
+#include "rombuf.h"
+#include "stats.h"
 
 #define DEFAULT_CHAR ((unsigned char) 0xFF)
 #define DEFAULT_SIZE 8
-#define Mbit * 1024 * 1024 / 8
+#define Mbit * ROM_MBIT
+#define PAD_CHUNK 0x40000
 #define PERR(str) fprintf(stderr, str)
 
-void pad(ssize_t, unsigned char, FILE*);
+int pad(off_t, unsigned char, int, int, off_t*);
+int pad_stream(off_t, unsigned char, int, int, int, off_t*);
+int read_all(struct rom_input*, unsigned char const**, size_t*,
+             unsigned char**);
+void fix_header(unsigned char*, unsigned char const*, size_t, off_t,
+                unsigned char);
+int fill(struct rom_output*, off_t, unsigned char);
 void print_help();
 void print_license();
 
 int
 main(int argc, char* argv[])
 {
-	int ch = 0, hflag = 0, lflag = 0;
+	int ch = 0, fflag = 0, hflag = 0, lflag = 0, vflag = 0;
 	ssize_t pad_to = DEFAULT_SIZE Mbit;
 	unsigned char pad_with = DEFAULT_CHAR;
-	while ( (ch = getopt(argc, argv, "h?lc:s:")) != -1 )
+	off_t added = 0;
+	rom_stats_start(argv[0]);
+	while ( (ch = getopt(argc, argv, "fh?lc:s:v")) != -1 )
 	{
 		switch (ch)
 		{
+		case 'f':
+			fflag = 1;
+			break;
 		case 'h':
 		case '?':
 			hflag = 1;
@@ -35,6 +54,9 @@ main(int argc, char* argv[])
 		case 'l':
 			lflag = 1;
 			break;
+		case 'v':
+			vflag = 1;
+			break;
 		case 'c':
 			if (sscanf(optarg, "%hhi", &pad_with) != 1)
 			{
@@ -77,33 +99,344 @@ main(int argc, char* argv[])
 	}
 	else
 	{
-		if (argc == 1)
+		if (argc == 1 && strcmp(argv[0], "-") == 0)
+		{
+			if (pad_stream(pad_to, pad_with, fflag, STDIN_FILENO,
+			               STDOUT_FILENO, &added) != 0)
+			{
+				err(errno, "Could not pad standard input");
+			}
+		}
+		else if (argc == 1)
 		{
-			FILE *ostream;
-			ostream =	fopen(argv[0], "ab");
-			if (ostream == NULL)
+			int ofile;
+			ofile = open(argv[0], O_RDWR | O_CREAT, 0666);
+			if (ofile == -1)
 			{
 				err(errno, "Could not open file %s", argv[0]);
 				return EXIT_FAILURE;
 			}
 
-			pad(pad_to, pad_with, ostream);
-			fclose(ostream);
+			if (pad(pad_to, pad_with, fflag, ofile, &added) != 0
+			    || close(ofile) != 0)
+			{
+				err(errno, "Could not pad file %s", argv[0]);
+			}
+		}
+		if (vflag)
+		{
+			fprintf(stderr, "%lld bytes added\n", (long long)added);
 		}
 	}
 	return EXIT_SUCCESS;
 }
 
 
+/* Fill the file from its end up to `pad_to' bytes, and set `*added'
+ * to the number of bytes that took.  Zero padding is only a matter of
+ * extending the file, which leaves the new tail as a hole where the
+ * filesystem can.  Any other padding is reserved in one go, then mapped
+ * and filled in memory where possible, or written a chunk at a time
+ * otherwise.  If `fix' is set, the checksum of the padded rom is worked
+ * out from the file as it was (see fix_header), and patched in after.
+ * Returns 0, or -1 with errno set.
+ */
+int
+pad(off_t pad_to, unsigned char pad_with, int fix, int fd, off_t *added)
+{
+	unsigned char header[ROM_HEADER_SIZE];
+	struct rom_input in;
+	struct rom_output out;
+	struct rom_timer timer;
+	struct stat st;
+	unsigned char const *data = NULL;
+	size_t n;
+	int status;
+
+	*added = 0;
+	if (fstat(fd, &st) != 0)
+	{
+		return -1;
+	}
+	if (fix)
+	{
+		if (rom_input_open(&in, fd) != 0)
+		{
+			return -1;
+		}
+		n = rom_input_read(&in, &data, st.st_size);
+		if (n == (size_t)-1)
+		{
+			rom_input_close(&in);
+			return -1;
+		}
+		fix_header(header, data, n,
+		           (st.st_size < pad_to) ? pad_to : st.st_size, pad_with);
+		rom_input_close(&in);
+	}
+
+	if (st.st_size >= pad_to)
+	{
+		/* nothing to add */
+	}
+	else if (pad_with == 0 && S_ISREG(st.st_mode))
+	{
+		/* the tail is left sparse, so no bytes are written */
+		rom_stats_begin(&timer);
+		status = ftruncate(fd, pad_to);
+		rom_stats_end(&timer, ROM_PHASE_WRITE);
+		rom_stats_count(ROM_STAT_WRITE_CALLS, 1);
+		if (status != 0)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		rom_stats_count(ROM_STAT_SEEK_CALLS, 1);
+		if (lseek(fd, st.st_size, SEEK_SET) == -1
+		    || rom_output_open(&out, fd, st.st_size,
+		                       pad_to - st.st_size) != 0)
+		{
+			return -1;
+		}
+		if (fill(&out, pad_to - st.st_size, pad_with) != 0)
+		{
+			rom_output_close(&out);
+			return -1;
+		}
+		if (rom_output_close(&out) != 0)
+		{
+			return -1;
+		}
+	}
+	if (st.st_size < pad_to)
+	{
+		*added = pad_to - st.st_size;
+	}
+
+	if (fix && (st.st_size >= ROM_CHECKSUM_LOCATION + 2
+	            || pad_to >= ROM_CHECKSUM_LOCATION + 2))
+	{
+		rom_stats_begin(&timer);
+		status = (pwrite(fd, header + ROM_CHECKSUM_LOCATION, 2,
+		                 ROM_CHECKSUM_LOCATION) == 2) ? 0 : -1;
+		rom_stats_end(&timer, ROM_PHASE_WRITE);
+		rom_stats_count(ROM_STAT_WRITE_CALLS, 1);
+		if (status != 0)
+		{
+			return -1;
+		}
+		rom_stats_count(ROM_STAT_BYTES_WRITTEN, 2);
+	}
+	return 0;
+}
+
+/* Copy `ifile' to `ofile', then pad what was copied up to `pad_to'
+ * bytes, and set `*added' to the number of bytes of padding.
+ * If `fix' is set, the checksum goes in the header, which is written
+ * first, so the whole input is read before anything is written.
+ * Returns 0, or -1 with errno set.
+ */
+int
+pad_stream(off_t pad_to, unsigned char pad_with, int fix, int ifile,
+           int ofile, off_t *added)
+{
+	unsigned char header[ROM_HEADER_SIZE];
+	struct rom_input in;
+	struct rom_output out;
+	unsigned char const *data;
+	unsigned char *all = NULL;
+	off_t size, copied = 0, length = 0;
+	size_t n;
+	int status = -1;
+	int saved;
+
+	*added = 0;
+	if (rom_input_open(&in, ifile) != 0)
+	{
+		return -1;
+	}
+	size = rom_input_remaining(&in);
+	if (size >= 0 && size < pad_to)
+	{
+		size = pad_to;
+	}
+	if (rom_output_open(&out, ofile, -1, size) != 0)
+	{
+		rom_input_close(&in);
+		return -1;
+	}
+
+	if (fix)
+	{
+		if (read_all(&in, &data, &n, &all) != 0)
+		{
+			goto done;
+		}
+		size = ((off_t)n < pad_to) ? pad_to : (off_t)n;
+		fix_header(header, data, n, size, pad_with);
+		copied = (size < ROM_HEADER_SIZE) ? size : ROM_HEADER_SIZE;
+		if (rom_output_write(&out, header, copied) != 0
+		    || ((off_t)n > copied
+		        && rom_output_write(&out, data + copied, n - copied) != 0))
+		{
+			goto done;
+		}
+		length = n;
+		if (length > copied)
+		{
+			copied = length;
+		}
+	}
+	else
+	{
+		do
+		{
+			n = rom_input_read(&in, &data, PAD_CHUNK);
+			if (n == (size_t)-1 || rom_output_write(&out, data, n) != 0)
+			{
+				goto done;
+			}
+			copied += n;
+		} while (n > 0);
+		length = copied;
+	}
+	if (copied < pad_to)
+	{
+		if (fill(&out, pad_to - copied, pad_with) != 0)
+		{
+			goto done;
+		}
+	}
+	status = 0;
+
+done:
+	saved = errno;
+	if (rom_output_close(&out) != 0 && status == 0)
+	{
+		saved = errno;
+		status = -1;
+	}
+	if (status == 0 && length < pad_to)
+	{
+		*added = pad_to - length;
+	}
+	rom_input_close(&in);
+	free(all);
+	errno = saved;
+	return status;
+}
+
+/* Point `*data' at the whole of the input, and set `*size' to its
+ * length.  A mapped input is used as it is; anything else is read into
+ * `*buffer', which the caller frees.
+ * Returns 0, or -1 with errno set.
+ */
+int
+read_all(struct rom_input *in, unsigned char const **data, size_t *size,
+         unsigned char **buffer)
+{
+	unsigned char const *chunk;
+	unsigned char *more;
+	size_t capacity = 0;
+	size_t n;
+	off_t remaining = rom_input_remaining(in);
+
+	*size = 0;
+	if (remaining >= 0)
+	{
+		n = rom_input_read(in, data, remaining);
+		if (n == (size_t)-1)
+		{
+			return -1;
+		}
+		*size = n;
+		return 0;
+	}
+	do
+	{
+		n = rom_input_read(in, &chunk, PAD_CHUNK);
+		if (n == (size_t)-1)
+		{
+			return -1;
+		}
+		if (*size + n > capacity)
+		{
+			capacity = 2 * (*size + n);
+			more = realloc(*buffer, capacity);
+			if (more == NULL)
+			{
+				return -1;
+			}
+			*buffer = more;
+		}
+		if (n > 0)
+		{
+			memcpy(*buffer + *size, chunk, n);
+		}
+		*size += n;
+	} while (n > 0);
+	*data = *buffer;
+	return 0;
+}
+
+/* Fill `header' with the first ROM_HEADER_SIZE bytes that the rom
+ * `data' of `size' bytes will have once padded to `final_size' bytes,
+ * with its checksum fixed.  The rom itself is summed once, and the
+ * padding is accounted for without being made: every padded word is
+ * the same, so its share of the sum depends only on how many there are.
+ * The sum runs to the rom size in the header, as mdchksum's does.
+ */
 void
-pad(ssize_t pad_to, unsigned char pad_with, FILE *ostream)
+fix_header(unsigned char *header, unsigned char const *data, size_t size,
+           off_t final_size, unsigned char pad_with)
 {
-	ssize_t cpos = ftell(ostream);
-	while (cpos < pad_to)
+	struct rom_checksum state;
+	off_t end;
+	size_t n = (size < ROM_HEADER_SIZE) ? size : ROM_HEADER_SIZE;
+
+	if (n > 0)
+	{
+		memcpy(header, data, n);
+	}
+	memset(header + n, pad_with, ROM_HEADER_SIZE - n);
+	end = rom_header_size(header);
+	if (end > final_size)
+	{
+		end = final_size;
+	}
+	rom_checksum_init(&state, 0);
+	if (size > 0)
+	{
+		rom_checksum_update(&state, data,
+		                    ((off_t)size < end) ? size : (size_t)end);
+	}
+	rom_fix_checksum(header, ROM_HEADER_SIZE,
+	                 (state.sum + rom_fill_checksum(size, end, pad_with))
+	                 % 65536);
+}
+
+/* Write `length' bytes of `pad_with', a chunk at a time.
+ * Returns 0, or -1 with errno set.
+ */
+int
+fill(struct rom_output *out, off_t length, unsigned char pad_with)
+{
+	unsigned char *dest;
+	size_t n;
+
+	for (; length > 0; length -= n)
 	{
-		fputc(pad_with, ostream);
-		++cpos;
+		n = (length < PAD_CHUNK) ? length : PAD_CHUNK;
+		dest = rom_output_next(out, n);
+		if (dest == NULL)
+		{
+			return -1;
+		}
+		rom_pad(dest, 0, n, pad_with);
 	}
+	return 0;
 }
 
 
@@ -112,12 +445,16 @@ print_help()
 {
 	PERR("mbitpad Copyright (c) 2014, Dakotah Lambert.\n");
 	PERR("All rights reserved.\n\n");
-	PERR("usage: mbitpad [-h?l] [-c pad_char] [-s size] file\n\n");
+	PERR("usage: mbitpad [-fh?lv] [-c pad_char] [-s size] file\n\n");
 	PERR("  -h, -? : show this message\n");
 	PERR("  -l     : display license information\n");
+	PERR("  -v     : report how many bytes were added\n");
+	PERR("  -f     : also fix the Genesis checksum of the padded rom,\n");
+	PERR("           without reading the padding back\n");
 	PERR("  -c     : ASCII value of char to pad with\n");
 	PERR("  -s     : size to which the file should be padded\n");
-	PERR("  file   : name of file to pad\n\n");
+	PERR("  file   : name of file to pad, or - to copy standard input\n");
+	PERR("           to standard output with the padding after it\n\n");
 	PERR("Example:\n");
 	PERR("mbitpad -c 0xFF -s 4 rom.bin\n");
 	PERR("  pads rom.bin with character <FF> to 4 Mbit (0.5 MB)\n\n");
@@ -0,0 +1,31 @@
+#!/bin/sh
+# bench.sh: show how mdchksum -j scales with the number of threads
+# usage: bench.sh [mdchksum] [megabits] [max_jobs]
+#
+# A random ROM of the given size (default 256 Mbit) with a valid header
+# is made by mdbench (see ../bench, or set MDBENCH), and checksummed with
+# 1, 2, ... max_jobs threads (default: the number of online processors).
+# The best of five runs is reported for each thread count.
+
+MDCHKSUM=${1:-./mdchksum}
+MBITS=${2:-256}
+MAX_JOBS=${3:-$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4)}
+MDBENCH=${MDBENCH:-$(dirname "$0")/../bench/mdbench}
+ROM=$(mktemp "${TMPDIR:-/tmp}/mdchksum-bench.XXXXXX") || exit 1
+trap 'rm -f "${ROM}"' EXIT INT TERM
+
+"${MDBENCH}" gen "${MBITS}" "${ROM}" || exit 1
+SIZE=$(wc -c <"${ROM}" | tr -d ' ')
+
+printf '%6s %10s %10s %8s\n' jobs seconds 'MB/s' speedup
+j=1
+BASE=
+while [ "${j}" -le "${MAX_JOBS}" ]; do
+	set -- $("${MDBENCH}" run -n 5 "${MDCHKSUM}" -j "${j}" "${ROM}") \
+	|| exit 1
+	[ $# -eq 2 ] || exit 1
+	[ -z "${BASE}" ] && BASE=$1
+	echo "${j} $1 ${SIZE} ${BASE}" \
+	| awk '{ printf "%6d %10.4f %10.1f %7.2fx\n", $1, $2, $3 / $2 / 1e6, $4 / $2 }'
+	j=$((j + 1))
+done
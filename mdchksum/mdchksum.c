@@ -2,90 +2,286 @@
  * mdchksum: read and fix checksums on Sega Genesis / Mega Drive roms
  * See the file ``COPYING'' for license information.
  *************************************************************************** */
-#define _POSIX_C_SOURCE 200112L
+#ifdef __linux__
+/* copy_file_range and splice */
+#define _GNU_SOURCE
+#endif
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "checksum.h"
+#include "detect.h"
+#include "hash.h"
+#include "rombuf.h"
+#include "smd.h"
+#include "stats.h"
+
 enum {
 	E_SUCCESS   = 0,
 	E_USAGE     = 1,
 	E_NXFILE    = 2,
 	E_OUTPUT    = 3,
 	E_READ      = 4,
-	E_NOMEM     = 5
+	E_NOMEM     = 5,
+	E_MISMATCH  = 6
 };
 enum {
 	M_CALC   = 1,
 	M_READ   = 2,
 	M_WRITE  = 4,
-	M_FIX    = 8
+	M_FIX    = 8,
+	M_BATCH  = 16,
+	M_DIFF   = 32,
+	M_HASH   = 64
 };
 
-#define CHECKSUM_LOCATION    0x18e
 #define CHECKSUM_SIZE        0x002
-#define DATA_START           0x200
-#define SIZE_FIELD_LOCATION  0x1a4
-#define SIZE_FIELD_SIZE      0x004
-#define ROM_HEADER_SIZE      0x200
-
-static unsigned int calculate_checksum(unsigned char const * const restrict, size_t const);
-static unsigned int find_stored_checksum(unsigned char const * const restrict, size_t const);
-static void fix_checksum(unsigned char * const restrict, size_t const, unsigned int const);
+#define CHUNK_SIZE           0x10000
+#define INDEX_BLOCK_SIZE     0x4000
+#define INDEX_SUFFIX         ".mdx"
+#define INDEX_MAGIC          "mdchksum-index 1"
+/* hashing reads a whole number of SMD blocks at a time */
+#define HASH_CHUNK           (16 * ROM_SMD_BLOCK_SIZE)
+#define HASH_SLOTS           4
+
+/* one thread's share of a parallel checksum */
+struct checksum_job
+{
+	/* input file, read with pread unless it is mapped */
+	int fd;
+	unsigned char const *map;
+	off_t map_size;
+	/* offset of the ROM within the input */
+	off_t base;
+	/* partial sum of ROM bytes [state.offset, end) */
+	struct rom_checksum state;
+	size_t end;
+	/* E_SUCCESS, or the error that stopped the job */
+	int status;
+	pthread_t thread;
+};
+
+/* a set of ROMs to verify, shared by the batch workers */
+struct batch
+{
+	/* paths from the command line, or NULL to read them from `list' */
+	char **paths;
+	int npaths;
+	int next;
+	FILE *list;
+	/* write JSON Lines rather than CSV */
+	int json;
+	/* which kinds of failure have been seen */
+	int saw_nxfile;
+	int saw_read;
+	int saw_mismatch;
+	pthread_mutex_t lock;
+};
+
+/* everything -H reports about one ROM, taken in one pass
+ * over its BIN view
+ * */
+struct rom_hashes
+{
+	enum rom_format format;
+	/* bytes of the BIN view so far */
+	off_t size;
+	struct rom_checksum sum;
+	/* end of the ROM according to its header */
+	off_t sum_end;
+	uint32_t crc32;
+	struct rom_md5 md5;
+	struct rom_sha1 sha1;
+};
+
+/* pieces of the BIN view passed from the reader to the threads that
+ * take the MD5 and SHA-1, HASH_SLOTS pieces ahead at most
+ * */
+struct hash_pipe
+{
+	unsigned char const *piece[HASH_SLOTS];
+	size_t length[HASH_SLOTS];
+	/* pieces handed over, and pieces each thread has finished */
+	unsigned long made;
+	unsigned long used[2];
+	int done;
+	struct rom_hashes *hashes;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+/* one of the threads of a hash_pipe */
+struct hash_lane
+{
+	struct hash_pipe *pipe;
+	int lane;
+	pthread_t thread;
+};
+
+/* contents of a sidecar index: the partial sum and a hash of each
+ * INDEX_BLOCK_SIZE block of a ROM, and the file state they describe
+ * */
+struct rom_index
+{
+	size_t rom_size;
+	off_t file_size;
+	struct timespec mtime;
+	size_t nblocks;
+	unsigned int *sums;
+	uint64_t *hashes;
+};
+
+static int verify_batch(char ** const, int const, int const, int const);
+static void *batch_worker(void *);
+static int verify_rom(char const * const, unsigned int * const, unsigned int * const);
+static void print_result(struct batch * const, char const * const, int const, unsigned int const, unsigned int const);
+static void print_string(char const *, int const);
+static int hash_files(char ** const, int const, int const, int const);
+static int hash_rom(struct rom_input * const, int const, struct rom_hashes * const);
+static void hash_piece(struct rom_hashes * const, unsigned char const *, size_t const, int const);
+static int pipe_start(struct hash_pipe * const, struct hash_lane * const, struct rom_hashes * const);
+static void pipe_put(struct hash_pipe * const, unsigned char const * const, size_t const);
+static void pipe_finish(struct hash_pipe * const, struct hash_lane * const);
+static void *hash_worker(void *);
+static void print_hashes(char const * const, int const, struct rom_hashes * const, int const);
+static unsigned char *read_rom(struct rom_input * const, unsigned char const * const, size_t const);
+static int stream_rom(struct rom_input * const, size_t const, FILE * const, struct rom_checksum * const);
+static int copy_rom(struct rom_input * const, size_t const);
+static off_t copy_in_kernel(int const, off_t const, int const, size_t const);
+static int patch_checksum(char const * const, unsigned char * const, size_t const, unsigned int const);
+static int stream_fix(struct rom_input * const, unsigned char * const, size_t const, size_t const, off_t const, int const, char const * const);
+static int sum_rom(struct rom_input * const, off_t const, size_t const, int const, char const * const, struct rom_checksum * const);
+static int indexed_sum(int const, off_t const, char const * const, size_t const, int const, struct rom_checksum * const);
+static void touch_index(char const * const, char const * const);
+static int load_index(char const * const, struct rom_index * const);
+static int save_index(char const * const, struct rom_index const * const);
+static int read_block(int const, unsigned char * const, size_t const, off_t const);
+static ssize_t timed_pread(int const, unsigned char * const, size_t const, off_t const);
+static int put(void const * const, size_t const, FILE * const);
+static uint64_t block_hash(unsigned char const * const, size_t const);
+static void *checksum_worker(void *);
 static void print_help(void);
 static void print_version(void);
 
 int
 main(int argc, char* argv[])
 {
-	/* buffer to store rom header and complete ROM */
+	/* buffer to store rom header */
 	unsigned char rom_header[ROM_HEADER_SIZE];
-	unsigned char *rom;
 	/* input file name, used as output for in-place operations */
 	char *fname      = NULL;
+	/* name of the sidecar index, if one is in use */
+	char *index_path = NULL;
 	/* option character */
 	int c;
 	/* an error has occurred */
 	int errflag      = 0;
+	/* batch results are written as JSON Lines */
+	int json         = 0;
 	/* help is requested */
 	int hflag        = 0;
-	/* loop counter */
-	int i;
+	/* the input, mapped if it is a regular file */
+	struct rom_input input;
+	/* the header as it was read */
+	unsigned char const *data;
+	/* offset of the ROM within the input, or -1 if it cannot seek */
+	off_t in_start;
 	/* in-place operation */
 	int iflag        = 0;
+	/* number of threads to checksum with */
+	int jobs         = 1;
 	/* operation to perform */
 	int mode         = 0;
 	/* length of ROM file in bytes, as read from the header */
-	int rom_size     = 0;
+	size_t rom_size;
+	/* bytes of the header that belong to the ROM */
+	size_t header_size;
+	/* running checksum for streamed input */
+	struct rom_checksum state = {0, 0};
+	/* exit status */
+	int status       = E_SUCCESS;
 	/* want version info */
 	int vflag        = 0;
+	/* use a sidecar index */
+	int xflag        = 0;
 	/* data to write in explicit mode */
 	int wnum         = 0;
+	/* checksum to store during an in-place edit */
+	unsigned int checksum;
+
+	/* Statistics keep their own copy of stderr, if they are wanted
+	 * */
+	rom_stats_start(argv[0]);
 
 	/* We do not use stderr
 	 * */
 	fclose(stderr);
 
-	while ((c = getopt(argc, argv, ":cfirVw:")) != -1)
+	while ((c = getopt(argc, argv, ":bcdfHij:o:rVw:x")) != -1)
 	{
 		switch (c)
 		{
+		case 'b':
+			if ((mode |= M_BATCH) & ~M_BATCH)
+			{
+				errflag = 1;
+			}
+			break;
 		case 'c':
 			if ((mode |= M_CALC) & ~M_CALC)
 			{
 				errflag = 1;
 			}
 			break;
+		case 'd':
+			if ((mode |= M_DIFF) & ~M_DIFF)
+			{
+				errflag = 1;
+			}
+			break;
 		case 'f':
 			if ((mode |= M_FIX) & ~M_FIX)
 			{
 				errflag = 1;
 			}
 			break;
+		case 'H':
+			if ((mode |= M_HASH) & ~M_HASH)
+			{
+				errflag = 1;
+			}
+			break;
 		case 'i':
 			iflag = 1;
 			break;
+		case 'j':
+			if (sscanf(optarg, "%i", &jobs) != 1 || jobs < 1)
+			{
+				errflag = 1;
+			}
+			break;
+		case 'o':
+			if (strcmp(optarg, "json") == 0)
+			{
+				json = 1;
+			}
+			else if (strcmp(optarg, "csv") == 0)
+			{
+				json = 0;
+			}
+			else
+			{
+				errflag = 1;
+			}
+			break;
 		case 'r':
 			if ((mode |= M_READ) & ~M_READ)
 			{
@@ -102,6 +298,9 @@ main(int argc, char* argv[])
 			}
 			sscanf(optarg, "%i", &wnum);
 			break;
+		case 'x':
+			xflag = 1;
+			break;
 		case '?':
 		default:
 			hflag = 1;
@@ -124,6 +323,14 @@ main(int argc, char* argv[])
 	{
 		mode = M_CALC;  /* Default mode is "calculate" */
 	}
+	if (mode == M_BATCH)
+	{
+		exit(verify_batch(argv + optind, argc - optind, jobs, json));
+	}
+	if (mode == M_HASH)
+	{
+		exit(hash_files(argv + optind, argc - optind, jobs, json));
+	}
 	if ((optind < argc) && (strncmp(argv[optind], "-", 2) != 0))
 	{
 		fname = argv[optind];
@@ -132,152 +339,1574 @@ main(int argc, char* argv[])
 	{
 		fname = NULL;
 	}
-	if (freopen(fname, "rb", stdin) == NULL)
-	{
-		exit(E_NXFILE);
-	}
-
-	/* Read the ROM header into memory */
-	if (fread(rom_header, 1, ROM_HEADER_SIZE, stdin) < ROM_HEADER_SIZE)
+	if (mode == M_DIFF && fname == NULL)
 	{
-		exit(E_READ);
+		/* an index belongs to a named file */
+		print_help();
+		exit(E_USAGE);
 	}
-	for (i = 0; i < SIZE_FIELD_SIZE; ++i)
+	if ((xflag || mode == M_DIFF) && fname != NULL)
 	{
-		rom_size *= 256;
-		rom_size += rom_header[SIZE_FIELD_LOCATION + i];
+		index_path = malloc(strlen(fname) + sizeof(INDEX_SUFFIX));
+		if (index_path == NULL)
+		{
+			exit(E_NOMEM);
+		}
+		strcpy(index_path, fname);
+		strcat(index_path, INDEX_SUFFIX);
 	}
-	rom = calloc(rom_size, 1);
-	if (rom == NULL)
+	c = (fname == NULL) ? STDIN_FILENO : open(fname, O_RDONLY);
+	if (c == -1 || rom_input_open(&input, c) != 0)
 	{
-		exit(E_NOMEM);
+		exit(E_NXFILE);
 	}
-	memcpy(rom, rom_header, ROM_HEADER_SIZE);
-	if (fread(rom+ROM_HEADER_SIZE, 1, rom_size - ROM_HEADER_SIZE, stdin)
-	    < rom_size - ROM_HEADER_SIZE)
+
+	/* Remember where the ROM starts in case a second pass is needed */
+	in_start = lseek(input.fd, 0, SEEK_CUR);
+
+	/* Read the ROM header into memory */
+	if (rom_input_read(&input, &data, ROM_HEADER_SIZE) < ROM_HEADER_SIZE)
 	{
 		exit(E_READ);
 	}
-	/* If we are here, then `rom' contains the ROM image
-	 * and we assume it is safe to proceed.
-	 * We are also done reading, so we can close stdin.
-	 * */
-	fclose(stdin);
+	memcpy(rom_header, data, ROM_HEADER_SIZE);
+	rom_size = rom_header_size(rom_header);
+	header_size = (rom_size < ROM_HEADER_SIZE) ? rom_size : ROM_HEADER_SIZE;
 
-	/* If not inplace OR not editing the file,
-	 * discard output information
+	/* An in-place edit only has to touch the checksum field,
+	 * which is patched with a positioned write.
 	 * */
-	if (!iflag || !(mode & (M_FIX | M_WRITE)))
+	if (iflag && fname != NULL && (mode & (M_FIX | M_WRITE)))
 	{
-		fname = NULL;
+		checksum = wnum;
+		if (mode == M_FIX)
+		{
+			rom_checksum_update(&state, rom_header, header_size);
+			status = sum_rom(&input, in_start, rom_size, jobs, index_path,
+			                 &state);
+			checksum = state.sum;
+		}
+		rom_input_close(&input);
+		close(input.fd);
+		if (status == E_SUCCESS)
+		{
+			status = patch_checksum(fname, rom_header, header_size, checksum);
+		}
+		if (status == E_SUCCESS && index_path != NULL)
+		{
+			touch_index(fname, index_path);
+		}
+		exit(status);
 	}
-	if (freopen(fname, "wb", stdout) == NULL)
+
+	if (freopen(NULL, "wb", stdout) == NULL)
 	{
 		exit(E_OUTPUT);
 	}
 
-	/* Perform operations on ROM data
+	/* Everything else streams the ROM through a fixed-size buffer
 	 * */
 	switch (mode)
 	{
 	case M_CALC:
-		printf("0x%04x\n", calculate_checksum(rom, rom_size));
+		rom_checksum_update(&state, rom_header, header_size);
+		status = sum_rom(&input, in_start, rom_size, jobs, index_path, &state);
+		if (status == E_SUCCESS)
+		{
+			printf("0x%04x\n", state.sum);
+		}
 		break;
 	case M_FIX:
-		fix_checksum(rom, rom_size, calculate_checksum(rom, rom_size));
+		status = stream_fix(&input, rom_header, header_size, rom_size,
+		                    in_start, jobs, index_path);
+		break;
+	case M_DIFF:
+		status = indexed_sum(input.fd, in_start, index_path, rom_size, 1,
+		                     &state);
 		break;
 	case M_READ:
-		printf("0x%04x\n", find_stored_checksum(rom, rom_size));
+		/* the stored checksum is in the header; nothing else is read */
+		printf("0x%04x\n",
+		       rom_find_stored_checksum(rom_header, header_size));
 		break;
 	case M_WRITE:
-		fix_checksum(rom, rom_size, wnum);
+		rom_fix_checksum(rom_header, header_size, wnum);
+		if (put(rom_header, header_size, stdout) != 0)
+		{
+			status = E_OUTPUT;
+			break;
+		}
+		status = copy_rom(&input, rom_size - header_size);
 		break;
 	default:
 		break;
 	}
-
-	if (mode & (M_WRITE | M_FIX))
+	rom_input_close(&input);
+	close(input.fd);
+	if (fclose(stdout) != 0 && status == E_SUCCESS)
 	{
-		fwrite(rom, 1, rom_size, stdout);
+		status = E_OUTPUT;
 	}
-	fclose(stdout);
 
-	exit(E_SUCCESS);
+	exit(status);
 }
-
-static unsigned int
-calculate_checksum(unsigned char const * const restrict buffer,
-                   size_t const size)
+
+/* Compare the stored and computed checksums of every ROM named in
+ * `paths', or, if there are none (or just "-"), of every ROM named on
+ * a line of the standard input.  `jobs' ROMs are checked at a time and
+ * one line is printed for each as it finishes.
+ * The exit status reflects the worst result:
+ * E_NXFILE if any ROM could not be opened, then E_READ if any could not
+ * be read in full, then E_MISMATCH if any checksum was wrong.
+ * */
+static int
+verify_batch(char ** const paths,
+             int const npaths,
+             int const jobs,
+             int const json)
 {
-	unsigned int checksum = 0;
+	struct batch batch;
+	pthread_t *threads;
+	int nthreads = 0;
 	int i;
 
-	for (i = DATA_START; i < size; i += 2)
+	batch.paths = paths;
+	batch.npaths = npaths;
+	batch.next = 0;
+	batch.list = NULL;
+	batch.json = json;
+	batch.saw_nxfile = 0;
+	batch.saw_read = 0;
+	batch.saw_mismatch = 0;
+	if (npaths == 0 || (npaths == 1 && strcmp(paths[0], "-") == 0))
+	{
+		batch.paths = NULL;
+		batch.list = stdin;
+	}
+	if (pthread_mutex_init(&batch.lock, NULL) != 0)
+	{
+		return E_NOMEM;
+	}
+	if (!json)
+	{
+		puts("path,stored,computed,status");
+	}
+	threads = calloc(jobs, sizeof(*threads));
+	if (threads != NULL)
+	{
+		while (nthreads < jobs - 1
+		       && pthread_create(&threads[nthreads], NULL,
+		                         batch_worker, &batch) == 0)
+		{
+			++nthreads;
+		}
+	}
+	batch_worker(&batch);
+	for (i = 0; i < nthreads; ++i)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&batch.lock);
+
+	if (fclose(stdout) != 0)
+	{
+		return E_OUTPUT;
+	}
+	return batch.saw_nxfile ? E_NXFILE
+		: batch.saw_read ? E_READ
+		: batch.saw_mismatch ? E_MISMATCH
+		: E_SUCCESS;
+}
+
+static void *
+batch_worker(void *arg)
+{
+	struct batch * const batch = arg;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t length;
+	char *path;
+	unsigned int stored, computed;
+	int status;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&batch->lock);
+		path = NULL;
+		if (batch->paths != NULL)
+		{
+			if (batch->next < batch->npaths)
+			{
+				path = batch->paths[batch->next++];
+			}
+		}
+		else
+		{
+			while (path == NULL
+			       && (length = getline(&line, &line_size, batch->list)) != -1)
+			{
+				if (length > 0 && line[length - 1] == '\n')
+				{
+					line[--length] = '\0';
+				}
+				if (length > 0)
+				{
+					path = strdup(line);
+				}
+			}
+		}
+		pthread_mutex_unlock(&batch->lock);
+		if (path == NULL)
+		{
+			break;
+		}
+
+		status = verify_rom(path, &stored, &computed);
+		print_result(batch, path, status, stored, computed);
+		if (batch->paths == NULL)
+		{
+			free(path);
+		}
+	}
+	free(line);
+	return NULL;
+}
+
+/* Find the stored and computed checksums of the ROM in file `path'
+ * */
+static int
+verify_rom(char const * const path,
+           unsigned int * const stored,
+           unsigned int * const computed)
+{
+	unsigned char header[ROM_HEADER_SIZE];
+	struct rom_input input;
+	struct checksum_job job;
+	size_t header_size;
+	size_t rom_size;
+
+	job.fd = open(path, O_RDONLY);
+	if (job.fd == -1)
+	{
+		return E_NXFILE;
+	}
+	rom_input_open(&input, job.fd);
+	if (timed_pread(job.fd, header, ROM_HEADER_SIZE, 0) < ROM_HEADER_SIZE)
+	{
+		rom_input_close(&input);
+		close(job.fd);
+		return E_READ;
+	}
+	rom_size = rom_header_size(header);
+	header_size = (rom_size < ROM_HEADER_SIZE) ? rom_size : ROM_HEADER_SIZE;
+	*stored = rom_find_stored_checksum(header, header_size);
+
+	job.map = input.map;
+	job.map_size = input.map_size;
+	job.base = 0;
+	job.state.sum = 0;
+	job.state.offset = 0;
+	job.end = rom_size;
+	job.status = E_SUCCESS;
+	rom_checksum_update(&job.state, header, header_size);
+	checksum_worker(&job);
+	*computed = job.state.sum;
+	rom_input_close(&input);
+	close(job.fd);
+	return job.status;
+}
+
+/* Print one line of batch output.
+ * Lines are written whole, so workers' output never interleaves.
+ * */
+static void
+print_result(struct batch * const batch,
+             char const * const path,
+             int const status,
+             unsigned int const stored,
+             unsigned int const computed)
+{
+	char const *result;
+
+	result = (status == E_NXFILE) ? "missing"
+		: (status != E_SUCCESS) ? "unreadable"
+		: (stored == computed) ? "ok"
+		: "mismatch";
+
+	pthread_mutex_lock(&batch->lock);
+	if (status == E_NXFILE)
+	{
+		batch->saw_nxfile = 1;
+	}
+	else if (status != E_SUCCESS)
+	{
+		batch->saw_read = 1;
+	}
+	else if (stored != computed)
+	{
+		batch->saw_mismatch = 1;
+	}
+
+	if (batch->json)
+	{
+		fputs("{\"path\":", stdout);
+		print_string(path, 1);
+		if (status == E_SUCCESS)
+		{
+			printf(",\"stored\":\"0x%04x\",\"computed\":\"0x%04x\"",
+			       stored, computed);
+		}
+		else
+		{
+			fputs(",\"stored\":null,\"computed\":null", stdout);
+		}
+		printf(",\"status\":\"%s\"}\n", result);
+	}
+	else
 	{
-		checksum += buffer[i] * 256;
-		checksum += buffer[i + 1];
-		checksum %= 65536;
+		print_string(path, 0);
+		if (status == E_SUCCESS)
+		{
+			printf(",0x%04x,0x%04x", stored, computed);
+		}
+		else
+		{
+			fputs(",,", stdout);
+		}
+		printf(",%s\n", result);
 	}
+	pthread_mutex_unlock(&batch->lock);
+}
 
-	return checksum;
+/* Print a string quoted for JSON if `json' is set,
+ * or quoted for CSV only where it has to be.
+ * */
+static void
+print_string(char const *str, int const json)
+{
+	if (json)
+	{
+		putchar('"');
+		for (; *str != '\0'; ++str)
+		{
+			if (*str == '"' || *str == '\\')
+			{
+				printf("\\%c", *str);
+			}
+			else if ((unsigned char)*str < 0x20)
+			{
+				printf("\\u%04x", (unsigned char)*str);
+			}
+			else
+			{
+				putchar(*str);
+			}
+		}
+		putchar('"');
+	}
+	else if (strpbrk(str, ",\"\r\n") != NULL)
+	{
+		putchar('"');
+		for (; *str != '\0'; ++str)
+		{
+			if (*str == '"')
+			{
+				putchar('"');
+			}
+			putchar(*str);
+		}
+		putchar('"');
+	}
+	else
+	{
+		fputs(str, stdout);
+	}
 }
 
-static unsigned int
-find_stored_checksum(unsigned char const * const restrict buffer,
-                     size_t const size)
+/* Hash each ROM named in `paths', or the standard input if there are
+ * none (or just "-"), and print one line for each.  With more than
+ * one job, the MD5 and SHA-1 of each ROM are taken on threads of their
+ * own as it is read.
+ * The exit status is that of the first ROM that failed, if any.
+ * */
+static int
+hash_files(char ** const paths,
+           int const npaths,
+           int const jobs,
+           int const json)
 {
-	unsigned int stored_sum = 0;
+	struct rom_input input;
+	struct rom_hashes hashes;
+	char const *path;
+	int status = E_SUCCESS;
+	int result;
+	int fd;
 	int i;
 
-	if (size < CHECKSUM_LOCATION + CHECKSUM_SIZE)
+	if (!json)
 	{
-		/* checksum location is not in buffer */
-		return 0;
+		puts("path,format,size,checksum,crc32,md5,sha1");
+	}
+	for (i = 0; i < npaths || (i == 0 && npaths == 0); ++i)
+	{
+		path = (npaths == 0) ? "-" : paths[i];
+		fd = (strcmp(path, "-") == 0) ? STDIN_FILENO : open(path, O_RDONLY);
+		if (fd == -1 || rom_input_open(&input, fd) != 0)
+		{
+			result = E_NXFILE;
+		}
+		else
+		{
+			result = hash_rom(&input, jobs, &hashes);
+			rom_input_close(&input);
+		}
+		if (fd > STDIN_FILENO)
+		{
+			close(fd);
+		}
+		print_hashes(path, result, &hashes, json);
+		if (status == E_SUCCESS)
+		{
+			status = result;
+		}
+	}
+	if (fclose(stdout) != 0 && status == E_SUCCESS)
+	{
+		status = E_OUTPUT;
+	}
+	return status;
+}
+
+/* Take every hash of the ROM in `input' in one pass.  An SMD image is
+ * deinterleaved a piece at a time, the bytes of a swapped one are put
+ * back in order, and the copier header of a padded one is skipped,
+ * so that each is hashed as the BIN it holds.  An image that is none
+ * of these is hashed as it is.
+ * */
+static int
+hash_rom(struct rom_input * const input,
+         int const jobs,
+         struct rom_hashes * const hashes)
+{
+	struct hash_pipe pipe;
+	struct hash_lane lanes[2];
+	unsigned char const *data;
+	unsigned char *buffers = NULL;
+	unsigned char *out;
+	unsigned long slot = 0;
+	off_t remaining;
+	size_t skip = 0;
+	size_t n, i;
+	int piped = 0;
+	int status = E_SUCCESS;
+
+	memset(hashes, 0, sizeof(*hashes));
+	rom_checksum_init(&hashes->sum, 0);
+	rom_md5_init(&hashes->md5);
+	rom_sha1_init(&hashes->sha1);
+
+	/* the first read is enough to tell the format */
+	n = rom_input_read(input, &data, ROM_DETECT_SIZE);
+	if (n == (size_t)-1)
+	{
+		return E_READ;
+	}
+	remaining = rom_input_remaining(input);
+	hashes->format = rom_detect(data, n, (remaining < 0) ? -1
+	                            : remaining + (off_t)n, NULL);
+	switch (hashes->format)
+	{
+	case ROM_FORMAT_SMD:
+	case ROM_FORMAT_PADDED:
+		skip = ROM_SMD_HEADER_SIZE;
+		break;
+	case ROM_FORMAT_UNKNOWN:
+		hashes->format = ROM_FORMAT_BIN;
+		break;
+	default:
+		break;
+	}
+
+	/* Pieces need a buffer of their own if they have to be changed,
+	 * or if they are read and must outlast the next read.
+	 * */
+	if (jobs > 1 && pipe_start(&pipe, lanes, hashes) == 0)
+	{
+		piped = 1;
+	}
+	if (hashes->format == ROM_FORMAT_SMD
+	    || hashes->format == ROM_FORMAT_SWAPPED
+	    || (piped && input->map == NULL))
+	{
+		buffers = malloc((piped ? HASH_SLOTS : 1) * HASH_CHUNK);
+		if (buffers == NULL)
+		{
+			status = E_NOMEM;
+			n = 0;
+		}
 	}
 
-	/* Read big-endian number */
-	for (i = CHECKSUM_LOCATION;
-	     i < CHECKSUM_LOCATION + CHECKSUM_SIZE;
-	     ++i)
+	while (n > skip)
+	{
+		data += skip;
+		n -= skip;
+		skip = 0;
+		out = (buffers == NULL) ? NULL
+			: buffers + (piped ? slot++ % HASH_SLOTS : 0) * HASH_CHUNK;
+		if (piped)
+		{
+			/* wait for the threads to be done with the slot */
+			pthread_mutex_lock(&pipe.lock);
+			while (pipe.made - pipe.used[0] >= HASH_SLOTS
+			       || pipe.made - pipe.used[1] >= HASH_SLOTS)
+			{
+				pthread_cond_wait(&pipe.cond, &pipe.lock);
+			}
+			pthread_mutex_unlock(&pipe.lock);
+		}
+		if (hashes->format == ROM_FORMAT_SMD)
+		{
+			n = rom_smd_decode(out, data, n);
+			data = out;
+		}
+		else if (hashes->format == ROM_FORMAT_SWAPPED)
+		{
+			for (i = 0; i + 1 < n; i += 2)
+			{
+				out[i] = data[i + 1];
+				out[i + 1] = data[i];
+			}
+			if (i < n)
+			{
+				out[i] = data[i];
+			}
+			data = out;
+		}
+		else if (out != NULL)
+		{
+			memcpy(out, data, n);
+			data = out;
+		}
+
+		if (piped)
+		{
+			pipe_put(&pipe, data, n);
+		}
+		hash_piece(hashes, data, n, !piped);
+
+		n = rom_input_read(input, &data, HASH_CHUNK);
+		if (n == (size_t)-1)
+		{
+			status = E_READ;
+			break;
+		}
+	}
+	if (piped)
 	{
-		stored_sum *= 256;
-		stored_sum += buffer[i];
+		pipe_finish(&pipe, lanes);
 	}
-	return stored_sum;
+	free(buffers);
+	return status;
 }
 
+/* Fold the next `length' bytes of the BIN view into the Genesis
+ * checksum, which stops where the header says the ROM ends, and the
+ * CRC-32, and into the MD5 and SHA-1 too if `all' is set.
+ * */
 static void
-fix_checksum(unsigned char * const restrict buffer,
-             size_t size,
-             unsigned int const checksum)
+hash_piece(struct rom_hashes * const hashes,
+           unsigned char const *data,
+           size_t const length,
+           int const all)
+{
+	size_t summed = length;
+
+	if (hashes->size == 0 && length >= ROM_HEADER_SIZE)
+	{
+		hashes->sum_end = rom_header_size(data);
+	}
+	if (hashes->size + (off_t)length > hashes->sum_end)
+	{
+		summed = (hashes->size < hashes->sum_end)
+			? hashes->sum_end - hashes->size : 0;
+	}
+	rom_checksum_update(&hashes->sum, data, summed);
+	hashes->crc32 = rom_crc32_update(hashes->crc32, data, length);
+	if (all)
+	{
+		rom_md5_update(&hashes->md5, data, length);
+		rom_sha1_update(&hashes->sha1, data, length);
+	}
+	hashes->size += length;
+}
+
+/* Start a thread each for the MD5 and the SHA-1 of `hashes'.
+ * Returns 0, or -1 if they could not be started.
+ * */
+static int
+pipe_start(struct hash_pipe * const pipe,
+           struct hash_lane * const lanes,
+           struct rom_hashes * const hashes)
 {
 	int i;
-	unsigned int cksum = checksum;
 
-	if (size < CHECKSUM_LOCATION + CHECKSUM_SIZE)
+	memset(pipe, 0, sizeof(*pipe));
+	pipe->hashes = hashes;
+	if (pthread_mutex_init(&pipe->lock, NULL) != 0)
 	{
-		/* checksum location is not in buffer */
-		return;
+		return -1;
+	}
+	if (pthread_cond_init(&pipe->cond, NULL) != 0)
+	{
+		pthread_mutex_destroy(&pipe->lock);
+		return -1;
+	}
+	for (i = 0; i < 2; ++i)
+	{
+		lanes[i].pipe = pipe;
+		lanes[i].lane = i;
+		if (pthread_create(&lanes[i].thread, NULL, hash_worker,
+		                   &lanes[i]) != 0)
+		{
+			break;
+		}
 	}
-	/* Write big-endian number */
-	for (i = CHECKSUM_SIZE - 1; i >= 0; --i)
+	if (i < 2)
 	{
-		buffer[CHECKSUM_LOCATION + i] = cksum % 256;
-		cksum /= 256;
+		pthread_mutex_lock(&pipe->lock);
+		pipe->done = 1;
+		pthread_mutex_unlock(&pipe->lock);
+		pthread_cond_broadcast(&pipe->cond);
+		while (i-- > 0)
+		{
+			pthread_join(lanes[i].thread, NULL);
+		}
+		pthread_cond_destroy(&pipe->cond);
+		pthread_mutex_destroy(&pipe->lock);
+		return -1;
 	}
+	return 0;
+}
+
+/* Hand the next piece to the threads; its slot must be free.
+ * */
+static void
+pipe_put(struct hash_pipe * const pipe,
+         unsigned char const * const piece,
+         size_t const length)
+{
+	pthread_mutex_lock(&pipe->lock);
+	pipe->piece[pipe->made % HASH_SLOTS] = piece;
+	pipe->length[pipe->made % HASH_SLOTS] = length;
+	++pipe->made;
+	pthread_mutex_unlock(&pipe->lock);
+	pthread_cond_broadcast(&pipe->cond);
+}
+
+/* Let the threads finish what they have been given, and stop them.
+ * */
+static void
+pipe_finish(struct hash_pipe * const pipe, struct hash_lane * const lanes)
+{
+	pthread_mutex_lock(&pipe->lock);
+	pipe->done = 1;
+	pthread_mutex_unlock(&pipe->lock);
+	pthread_cond_broadcast(&pipe->cond);
+	pthread_join(lanes[0].thread, NULL);
+	pthread_join(lanes[1].thread, NULL);
+	pthread_cond_destroy(&pipe->cond);
+	pthread_mutex_destroy(&pipe->lock);
+}
+
+static void *
+hash_worker(void *arg)
+{
+	struct hash_lane * const lane = arg;
+	struct hash_pipe * const pipe = lane->pipe;
+	unsigned long const *used = &pipe->used[lane->lane];
+	unsigned char const *piece;
+	size_t length;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pipe->lock);
+		while (*used == pipe->made && !pipe->done)
+		{
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		}
+		if (*used == pipe->made)
+		{
+			pthread_mutex_unlock(&pipe->lock);
+			break;
+		}
+		piece = pipe->piece[*used % HASH_SLOTS];
+		length = pipe->length[*used % HASH_SLOTS];
+		pthread_mutex_unlock(&pipe->lock);
+
+		if (lane->lane == 0)
+		{
+			rom_md5_update(&pipe->hashes->md5, piece, length);
+		}
+		else
+		{
+			rom_sha1_update(&pipe->hashes->sha1, piece, length);
+		}
+
+		pthread_mutex_lock(&pipe->lock);
+		++pipe->used[lane->lane];
+		pthread_mutex_unlock(&pipe->lock);
+		pthread_cond_broadcast(&pipe->cond);
+	}
+	return NULL;
+}
+
+/* Print the hashes of the ROM at `path' as a line of CSV or JSON,
+ * or empty fields if it could not be hashed.
+ * */
+static void
+print_hashes(char const * const path,
+             int const status,
+             struct rom_hashes * const hashes,
+             int const json)
+{
+	unsigned char md5[ROM_MD5_SIZE];
+	unsigned char sha1[ROM_SHA1_SIZE];
+	char const *format = "";
+	int i;
+
+	if (status == E_SUCCESS)
+	{
+		rom_md5_final(&hashes->md5, md5);
+		rom_sha1_final(&hashes->sha1, sha1);
+		format = (hashes->format == ROM_FORMAT_BIN) ? "bin"
+			: (hashes->format == ROM_FORMAT_SMD) ? "smd"
+			: (hashes->format == ROM_FORMAT_SWAPPED) ? "swapped"
+			: "padded";
+	}
+	if (json)
+	{
+		fputs("{\"path\":", stdout);
+		print_string(path, 1);
+		if (status != E_SUCCESS)
+		{
+			printf(",\"status\":\"%s\"}\n",
+			       (status == E_NXFILE) ? "missing" : "unreadable");
+			return;
+		}
+		printf(",\"format\":\"%s\",\"size\":%lld,\"checksum\":\"0x%04x\""
+		       ",\"crc32\":\"%08lx\",\"md5\":\"", format,
+		       (long long)hashes->size, hashes->sum.sum,
+		       (unsigned long)hashes->crc32);
+	}
+	else
+	{
+		print_string(path, 0);
+		if (status != E_SUCCESS)
+		{
+			puts(",,,,,,");
+			return;
+		}
+		printf(",%s,%lld,0x%04x,%08lx,", format, (long long)hashes->size,
+		       hashes->sum.sum, (unsigned long)hashes->crc32);
+	}
+	for (i = 0; i < ROM_MD5_SIZE; ++i)
+	{
+		printf("%02x", md5[i]);
+	}
+	fputs(json ? "\",\"sha1\":\"" : ",", stdout);
+	for (i = 0; i < ROM_SHA1_SIZE; ++i)
+	{
+		printf("%02x", sha1[i]);
+	}
+	puts(json ? "\"}" : "");
+}
+
+/* Read the remainder of a ROM whose header has already been consumed
+ * and return the complete image.  Exits on failure.
+ * */
+static unsigned char *
+read_rom(struct rom_input * const input,
+         unsigned char const * const header,
+         size_t const rom_size)
+{
+	size_t const header_size = (rom_size < ROM_HEADER_SIZE)
+		? rom_size : ROM_HEADER_SIZE;
+	unsigned char const *data;
+	unsigned char *rom;
+
+	rom = calloc(rom_size ? rom_size : 1, 1);
+	if (rom == NULL)
+	{
+		exit(E_NOMEM);
+	}
+	memcpy(rom, header, header_size);
+	if (rom_input_read(input, &data, rom_size - header_size)
+	    != rom_size - header_size)
+	{
+		exit(E_READ);
+	}
+	memcpy(rom + header_size, data, rom_size - header_size);
+	return rom;
+}
+
+/* Move `length' bytes from `input' to `ostream' in CHUNK_SIZE pieces,
+ * folding each piece into `state' as it passes.  A mapped input is
+ * handed over in place, without being copied into a buffer first.
+ * Either `ostream' or `state' may be NULL.
+ * */
+static int
+stream_rom(struct rom_input * const input,
+           size_t const length,
+           FILE * const ostream,
+           struct rom_checksum * const state)
+{
+	unsigned char const *chunk;
+	size_t remaining = length;
+	size_t n;
+
+	while (remaining > 0)
+	{
+		n = (remaining < CHUNK_SIZE) ? remaining : CHUNK_SIZE;
+		if (rom_input_read(input, &chunk, n) != n)
+		{
+			return E_READ;
+		}
+		if (state != NULL)
+		{
+			rom_checksum_update(state, chunk, n);
+		}
+		if (ostream != NULL && put(chunk, n, ostream) != 0)
+		{
+			return E_OUTPUT;
+		}
+		remaining -= n;
+	}
+	return E_SUCCESS;
+}
+
+/* Move `length' bytes from `input' to stdout unchanged.  If the input
+ * is a regular file, the kernel is asked to move them without passing
+ * them through this process; whatever it will not move is streamed.
+ * */
+static int
+copy_rom(struct rom_input * const input, size_t const length)
+{
+	off_t copied;
+
+	if (input->size < 0 || length == 0)
+	{
+		return stream_rom(input, length, stdout, NULL);
+	}
+	/* what is already buffered has to go first */
+	if (fflush(stdout) != 0)
+	{
+		return E_OUTPUT;
+	}
+	copied = copy_in_kernel(input->fd, input->pos, fileno(stdout), length);
+	if (copied == -1)
+	{
+		return E_OUTPUT;
+	}
+	if (copied > 0 && rom_input_seek(input, input->pos + copied) != 0)
+	{
+		return E_READ;
+	}
+	return stream_rom(input, length - copied, stdout, NULL);
+}
+
+/* Copy up to `length' bytes from file `in' at `offset' to `out' at its
+ * current position with copy_file_range, which can share the blocks
+ * rather than copy them on a filesystem that supports it, or with
+ * splice if `out' is a pipe.  Returns the number of bytes copied, which
+ * is short if the calls are not supported or the input ends early, or
+ * -1 on a write error.
+ * */
+static off_t
+copy_in_kernel(int const in,
+               off_t const offset,
+               int const out,
+               size_t const length)
+{
+#ifdef __linux__
+	struct rom_timer timer;
+	struct stat st;
+	loff_t from = offset;
+	size_t done = 0;
+	ssize_t n;
+	int to_pipe;
+
+	if (fstat(out, &st) != 0 || !(S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode)))
+	{
+		return 0;
+	}
+	to_pipe = S_ISFIFO(st.st_mode);
+	rom_stats_begin(&timer);
+	while (done < length)
+	{
+		n = to_pipe
+			? splice(in, &from, out, NULL, length - done, SPLICE_F_MOVE)
+			: copy_file_range(in, &from, out, NULL, length - done, 0);
+		rom_stats_count(ROM_STAT_WRITE_CALLS, 1);
+		if (n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n == -1
+		    && (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+		        || errno == EOPNOTSUPP || errno == EBADF))
+		{
+			/* not between these two; the caller copies the rest */
+			break;
+		}
+		if (n == -1)
+		{
+			rom_stats_end(&timer, ROM_PHASE_WRITE);
+			return -1;
+		}
+		if (n == 0)
+		{
+			break;
+		}
+		done += n;
+	}
+	rom_stats_end(&timer, ROM_PHASE_WRITE);
+	rom_stats_count(ROM_STAT_BYTES_READ, done);
+	rom_stats_count(ROM_STAT_BYTES_WRITTEN, done);
+	return done;
+#else
+	(void)in;
+	(void)offset;
+	(void)out;
+	(void)length;
+	return 0;
+#endif
+}
+
+/* Fold the rest of the ROM, following the part already in `state',
+ * into the checksum.  If the input is seekable and more than one job
+ * is requested, the remainder is split into even-aligned ranges that
+ * are summed on separate threads, straight from the map if the input is
+ * mapped and read with pread otherwise; since the sum is taken modulo
+ * 65536, the partial sums can simply be added together.
+ * If `index_path' is not NULL, the sum is taken with the help of
+ * the sidecar index that it names instead.
+ * */
+static int
+sum_rom(struct rom_input * const input,
+        off_t const in_start,
+        size_t const rom_size,
+        int const jobs,
+        char const * const index_path,
+        struct rom_checksum * const state)
+{
+	struct checksum_job *job;
+	size_t const remaining = rom_size - state->offset;
+	size_t share;
+	size_t start;
+	int n;
+	int i;
+	int status = E_SUCCESS;
+
+	if (index_path != NULL && in_start != -1)
+	{
+		return indexed_sum(input->fd, in_start, index_path, rom_size, 0,
+		                   state);
+	}
+
+	/* give each thread at least a couple of chunks of work */
+	n = (remaining / (2 * CHUNK_SIZE) < (size_t)jobs)
+		? (int)(remaining / (2 * CHUNK_SIZE)) : jobs;
+	if (in_start == -1 || n < 2
+	    || (job = calloc(n, sizeof(*job))) == NULL)
+	{
+		return stream_rom(input, remaining, NULL, state);
+	}
+
+	share = (remaining / n + 1) & ~(size_t)1;
+	start = state->offset;
+	for (i = 0; i < n; ++i)
+	{
+		job[i].fd = input->fd;
+		job[i].map = input->map;
+		job[i].map_size = input->map_size;
+		job[i].base = in_start;
+		job[i].state.sum = 0;
+		job[i].state.offset = start;
+		job[i].end = (i == n - 1) ? rom_size : start + share;
+		job[i].status = E_SUCCESS;
+		start = job[i].end;
+		if (i > 0 && pthread_create(&job[i].thread, NULL,
+		                            checksum_worker, &job[i]) != 0)
+		{
+			/* no thread to be had; do the work here instead */
+			job[i].thread = pthread_self();
+			checksum_worker(&job[i]);
+		}
+	}
+	checksum_worker(&job[0]);
+
+	for (i = 0; i < n; ++i)
+	{
+		if (i > 0 && !pthread_equal(job[i].thread, pthread_self()))
+		{
+			pthread_join(job[i].thread, NULL);
+		}
+		if (job[i].status != E_SUCCESS)
+		{
+			status = job[i].status;
+		}
+		state->sum = (state->sum + job[i].state.sum) % 65536;
+	}
+	state->offset = rom_size;
+	free(job);
+	return status;
+}
+
+static void *
+checksum_worker(void *arg)
+{
+	struct checksum_job * const job = arg;
+	unsigned char *chunk;
+	size_t n;
+	ssize_t got;
+
+	if (job->map != NULL)
+	{
+		/* the whole range is already in memory */
+		n = job->end - job->state.offset;
+		if (job->base + (off_t)job->end > job->map_size)
+		{
+			job->status = E_READ;
+			return NULL;
+		}
+		rom_checksum_update(&job->state,
+		                    job->map + job->base + job->state.offset, n);
+		rom_stats_count(ROM_STAT_BYTES_READ, n);
+		return NULL;
+	}
+	chunk = malloc(CHUNK_SIZE);
+	if (chunk == NULL)
+	{
+		job->status = E_NOMEM;
+		return NULL;
+	}
+	while (job->state.offset < (off_t)job->end)
+	{
+		n = job->end - job->state.offset;
+		n = (n < CHUNK_SIZE) ? n : CHUNK_SIZE;
+		got = timed_pread(job->fd, chunk, n, job->base + job->state.offset);
+		if (got == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (got <= 0)
+		{
+			job->status = E_READ;
+			break;
+		}
+		rom_checksum_update(&job->state, chunk, got);
+	}
+	free(chunk);
+	return NULL;
+}
+
+/* Sum the ROM in file `fd' block by block with the help of the sidecar
+ * index at `index_path'.  If the file's size and modification time are
+ * those recorded in the index, the recorded sums are used without
+ * reading the ROM at all.  Otherwise each block is read and hashed, and
+ * only blocks whose hash has changed are summed again.  The index is
+ * then rewritten to describe the file as it is now.
+ * If `list' is set, the range of each changed block is printed instead,
+ * and the index is left as it was.
+ * Since the bytes before ROM_DATA_START do not count towards the sum,
+ * whatever part of the header is already in `state' is ignored.
+ * */
+static int
+indexed_sum(int const fd,
+            off_t const in_start,
+            char const * const index_path,
+            size_t const rom_size,
+            int const list,
+            struct rom_checksum * const state)
+{
+	struct rom_index old = {0, 0, {0, 0}, 0, NULL, NULL};
+	struct rom_index now;
+	struct rom_checksum block;
+	struct stat st;
+	unsigned char *chunk;
+	size_t start;
+	size_t n;
+	size_t i;
+	int have_old;
+	int status = E_SUCCESS;
+
+	if (fstat(fd, &st) != 0)
+	{
+		return E_READ;
+	}
+	have_old = (load_index(index_path, &old) == 0);
+	if (list && !have_old)
+	{
+		return E_NXFILE;
+	}
+
+	now.rom_size = rom_size;
+	now.file_size = st.st_size;
+	now.mtime = st.st_mtim;
+	now.nblocks = (rom_size + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+	if (!list && have_old && in_start == 0
+	    && old.rom_size == rom_size
+	    && old.file_size == st.st_size
+	    && old.mtime.tv_sec == st.st_mtim.tv_sec
+	    && old.mtime.tv_nsec == st.st_mtim.tv_nsec)
+	{
+		state->sum = 0;
+		for (i = 0; i < old.nblocks; ++i)
+		{
+			state->sum = (state->sum + old.sums[i]) % 65536;
+		}
+		state->offset = rom_size;
+		free(old.sums);
+		free(old.hashes);
+		return E_SUCCESS;
+	}
+
+	now.sums = calloc(now.nblocks ? now.nblocks : 1, sizeof(*now.sums));
+	now.hashes = calloc(now.nblocks ? now.nblocks : 1, sizeof(*now.hashes));
+	chunk = malloc(INDEX_BLOCK_SIZE);
+	if (now.sums == NULL || now.hashes == NULL || chunk == NULL)
+	{
+		status = E_NOMEM;
+	}
+	state->sum = 0;
+	for (i = 0; i < now.nblocks && status == E_SUCCESS; ++i)
+	{
+		start = i * INDEX_BLOCK_SIZE;
+		n = rom_size - start;
+		n = (n < INDEX_BLOCK_SIZE) ? n : INDEX_BLOCK_SIZE;
+		if ((status = read_block(fd, chunk, n, in_start + start))
+		    != E_SUCCESS)
+		{
+			break;
+		}
+		now.hashes[i] = block_hash(chunk, n);
+		if (have_old && i < old.nblocks && old.hashes[i] == now.hashes[i])
+		{
+			now.sums[i] = old.sums[i];
+		}
+		else
+		{
+			block.sum = 0;
+			block.offset = start;
+			rom_checksum_update(&block, chunk, n);
+			now.sums[i] = block.sum;
+			if (list)
+			{
+				printf("0x%06lx-0x%06lx\n",
+				       (unsigned long)start, (unsigned long)(start + n - 1));
+			}
+		}
+		state->sum = (state->sum + now.sums[i]) % 65536;
+	}
+	state->offset = rom_size;
+
+	if (status == E_SUCCESS && !list && in_start == 0)
+	{
+		/* the index is only a cache; failing to save it is harmless */
+		save_index(index_path, &now);
+	}
+	free(chunk);
+	free(now.sums);
+	free(now.hashes);
+	free(old.sums);
+	free(old.hashes);
+	return status;
+}
+
+/* After an in-place edit, bring the index for `fname' up to date:
+ * the edit changed the file's modification time and the hash of the
+ * first block, but not any block's partial sum.
+ * */
+static void
+touch_index(char const * const fname, char const * const index_path)
+{
+	struct rom_index index;
+	struct stat st;
+	unsigned char *chunk;
+	size_t n;
+	int fd;
+
+	if (load_index(index_path, &index) != 0)
+	{
+		return;
+	}
+	fd = open(fname, O_RDONLY);
+	chunk = malloc(INDEX_BLOCK_SIZE);
+	n = (index.rom_size < INDEX_BLOCK_SIZE) ? index.rom_size : INDEX_BLOCK_SIZE;
+	if (fd != -1 && chunk != NULL && index.nblocks > 0
+	    && read_block(fd, chunk, n, 0) == E_SUCCESS
+	    && fstat(fd, &st) == 0)
+	{
+		index.hashes[0] = block_hash(chunk, n);
+		index.file_size = st.st_size;
+		index.mtime = st.st_mtim;
+		save_index(index_path, &index);
+	}
+	if (fd != -1)
+	{
+		close(fd);
+	}
+	free(chunk);
+	free(index.sums);
+	free(index.hashes);
+}
+
+/* The index is a small text file:
+ *   mdchksum-index 1
+ *   <block size> <rom size> <file size> <mtime seconds> <mtime nanoseconds>
+ * followed by one line per block holding its partial sum and hash in hex.
+ * */
+static int
+load_index(char const * const index_path, struct rom_index * const index)
+{
+	char magic[sizeof(INDEX_MAGIC)];
+	unsigned long block_size, rom_size;
+	long long file_size, sec;
+	long nsec;
+	unsigned long long hash;
+	unsigned int sum;
+	size_t i;
+	FILE *f;
+
+	index->sums = NULL;
+	index->hashes = NULL;
+	f = fopen(index_path, "r");
+	if (f == NULL)
+	{
+		return -1;
+	}
+	if (fgets(magic, sizeof(magic), f) == NULL
+	    || strcmp(magic, INDEX_MAGIC) != 0
+	    || fscanf(f, "%lu %lu %lld %lld %ld",
+	              &block_size, &rom_size, &file_size, &sec, &nsec) != 5
+	    || block_size != INDEX_BLOCK_SIZE)
+	{
+		fclose(f);
+		return -1;
+	}
+	index->rom_size = rom_size;
+	index->file_size = file_size;
+	index->mtime.tv_sec = sec;
+	index->mtime.tv_nsec = nsec;
+	index->nblocks = (rom_size + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+	index->sums = calloc(index->nblocks ? index->nblocks : 1,
+	                     sizeof(*index->sums));
+	index->hashes = calloc(index->nblocks ? index->nblocks : 1,
+	                       sizeof(*index->hashes));
+	for (i = 0; index->sums != NULL && index->hashes != NULL
+	            && i < index->nblocks; ++i)
+	{
+		if (fscanf(f, "%x %llx", &sum, &hash) != 2)
+		{
+			break;
+		}
+		index->sums[i] = sum % 65536;
+		index->hashes[i] = hash;
+	}
+	fclose(f);
+	if (i < index->nblocks || index->sums == NULL || index->hashes == NULL)
+	{
+		free(index->sums);
+		free(index->hashes);
+		index->sums = NULL;
+		index->hashes = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Write the index to a temporary file and rename it into place,
+ * so that a reader never sees half of one.
+ * */
+static int
+save_index(char const * const index_path, struct rom_index const * const index)
+{
+	char *tmp_path;
+	size_t i;
+	FILE *f;
+	int status = 0;
+
+	tmp_path = malloc(strlen(index_path) + sizeof(".tmp"));
+	if (tmp_path == NULL)
+	{
+		return -1;
+	}
+	strcpy(tmp_path, index_path);
+	strcat(tmp_path, ".tmp");
+	f = fopen(tmp_path, "w");
+	if (f == NULL)
+	{
+		free(tmp_path);
+		return -1;
+	}
+	fprintf(f, "%s\n%lu %lu %lld %lld %ld\n", INDEX_MAGIC,
+	        (unsigned long)INDEX_BLOCK_SIZE, (unsigned long)index->rom_size,
+	        (long long)index->file_size, (long long)index->mtime.tv_sec,
+	        (long)index->mtime.tv_nsec);
+	for (i = 0; i < index->nblocks; ++i)
+	{
+		fprintf(f, "%04x %016llx\n",
+		        index->sums[i], (unsigned long long)index->hashes[i]);
+	}
+	if (fclose(f) != 0 || rename(tmp_path, index_path) != 0)
+	{
+		remove(tmp_path);
+		status = -1;
+	}
+	free(tmp_path);
+	return status;
+}
+
+/* Read exactly `length' bytes at `offset' with pread
+ * */
+static int
+read_block(int const fd,
+           unsigned char * const buffer,
+           size_t const length,
+           off_t const offset)
+{
+	size_t done = 0;
+	ssize_t got;
+
+	while (done < length)
+	{
+		got = timed_pread(fd, buffer + done, length - done, offset + done);
+		if (got == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (got <= 0)
+		{
+			return E_READ;
+		}
+		done += got;
+	}
+	return E_SUCCESS;
+}
+
+/* pread, counted for ROM_STATS
+ * */
+static ssize_t
+timed_pread(int const fd,
+            unsigned char * const buffer,
+            size_t const length,
+            off_t const offset)
+{
+	struct rom_timer timer;
+	ssize_t got;
+
+	rom_stats_begin(&timer);
+	got = pread(fd, buffer, length, offset);
+	rom_stats_end(&timer, ROM_PHASE_READ);
+	rom_stats_count(ROM_STAT_READ_CALLS, 1);
+	if (got > 0)
+	{
+		rom_stats_count(ROM_STAT_BYTES_READ, got);
+	}
+	return got;
+}
+
+/* Write all of `data' to `stream', counted for ROM_STATS; the calls
+ * counted are to the stream, which may batch them
+ * */
+static int
+put(void const * const data, size_t const length, FILE * const stream)
+{
+	struct rom_timer timer;
+	size_t done;
+
+	rom_stats_begin(&timer);
+	done = fwrite(data, 1, length, stream);
+	rom_stats_end(&timer, ROM_PHASE_WRITE);
+	rom_stats_count(ROM_STAT_WRITE_CALLS, 1);
+	rom_stats_count(ROM_STAT_BYTES_WRITTEN, done);
+	return (done < length) ? -1 : 0;
+}
+
+/* A fast non-cryptographic hash, good enough to tell whether a block
+ * has changed.  Four independent lanes keep the multiplier busy.
+ * */
+static uint64_t
+block_hash(unsigned char const * const data, size_t const length)
+{
+	uint64_t const k = 0x9e3779b97f4a7c15ULL;
+	uint64_t lane[4];
+	uint64_t word;
+	uint64_t h;
+	size_t i;
+	int j;
+
+	for (j = 0; j < 4; ++j)
+	{
+		lane[j] = (length + j) * k;
+	}
+	for (i = 0; i + 32 <= length; i += 32)
+	{
+		for (j = 0; j < 4; ++j)
+		{
+			memcpy(&word, data + i + 8 * j, 8);
+			lane[j] = (lane[j] ^ word) * 0xff51afd7ed558ccdULL;
+			lane[j] ^= lane[j] >> 32;
+		}
+	}
+	h = lane[0] ^ (lane[1] * 3) ^ (lane[2] * 5) ^ (lane[3] * 7);
+	for (; i < length; ++i)
+	{
+		h = (h ^ data[i]) * 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Store `checksum' in the header and write just the checksum field
+ * back to the file `fname', leaving the rest of the file untouched.
+ * */
+static int
+patch_checksum(char const * const fname,
+               unsigned char * const header,
+               size_t const header_size,
+               unsigned int const checksum)
+{
+	struct rom_timer timer;
+	int fd;
+	int status = E_SUCCESS;
+
+	if (header_size < ROM_CHECKSUM_LOCATION + CHECKSUM_SIZE)
+	{
+		/* checksum location is not in the ROM */
+		return E_SUCCESS;
+	}
+	rom_fix_checksum(header, header_size, checksum);
+	fd = open(fname, O_WRONLY);
+	if (fd == -1)
+	{
+		return E_OUTPUT;
+	}
+	rom_stats_begin(&timer);
+	if (pwrite(fd, header + ROM_CHECKSUM_LOCATION, CHECKSUM_SIZE,
+	           ROM_CHECKSUM_LOCATION) != CHECKSUM_SIZE)
+	{
+		status = E_OUTPUT;
+	}
+	rom_stats_end(&timer, ROM_PHASE_WRITE);
+	rom_stats_count(ROM_STAT_WRITE_CALLS, 1);
+	rom_stats_count(ROM_STAT_BYTES_WRITTEN, CHECKSUM_SIZE);
+	if (close(fd) != 0)
+	{
+		status = E_OUTPUT;
+	}
+	return status;
+}
+
+/* Write a copy of the ROM to stdout with its checksum corrected,
+ * holding no more than the header and one chunk in memory.
+ * The header has to be written first but cannot be finished
+ * until the whole ROM has been summed, so:
+ *  - if the input is seekable, sum it in one pass and copy it in a second;
+ *  - otherwise if the output is seekable, copy the ROM while summing it
+ *    and then go back to rewrite the header;
+ *  - otherwise there is no choice but to hold the whole ROM in memory.
+ * */
+static int
+stream_fix(struct rom_input * const input,
+           unsigned char * const header,
+           size_t const header_size,
+           size_t const rom_size,
+           off_t const in_start,
+           int const jobs,
+           char const * const index_path)
+{
+	struct rom_checksum state = {0, 0};
+	size_t const body_size = rom_size - header_size;
+	unsigned char *rom;
+	off_t out_start;
+	int flags;
+	int status;
+
+	rom_checksum_update(&state, header, header_size);
+
+	if (in_start != -1
+	    && rom_input_seek(input, in_start + ROM_HEADER_SIZE) == 0)
+	{
+		if ((status = sum_rom(input, in_start, rom_size, jobs, index_path,
+		                      &state)) != E_SUCCESS)
+		{
+			return status;
+		}
+		if (rom_input_seek(input, in_start + ROM_HEADER_SIZE) != 0)
+		{
+			return E_READ;
+		}
+		rom_fix_checksum(header, header_size, state.sum);
+		if (put(header, header_size, stdout) != 0)
+		{
+			return E_OUTPUT;
+		}
+		return copy_rom(input, body_size);
+	}
+
+	out_start = ftello(stdout);
+	flags = fcntl(fileno(stdout), F_GETFL);
+	if (out_start != -1 && flags != -1 && !(flags & O_APPEND))
+	{
+		if (put(header, header_size, stdout) != 0)
+		{
+			return E_OUTPUT;
+		}
+		if ((status = stream_rom(input, body_size, stdout, &state))
+		    != E_SUCCESS)
+		{
+			return status;
+		}
+		rom_fix_checksum(header, header_size, state.sum);
+		if (fseeko(stdout, out_start, SEEK_SET) != 0
+		    || put(header, header_size, stdout) != 0)
+		{
+			return E_OUTPUT;
+		}
+		return E_SUCCESS;
+	}
+
+	rom = read_rom(input, header, rom_size);
+	rom_fix_checksum(rom, rom_size, rom_calculate_checksum(rom, rom_size));
+	status = (put(rom, rom_size, stdout) != 0) ? E_OUTPUT : E_SUCCESS;
+	free(rom);
+	return status;
 }
 
 static void
 print_help(void)
 {
-	puts("Usage: mdchksum [-c|-f|-r|-w num] [-i] [-?V] [file]");
+	puts("Usage: mdchksum [-c|-f|-r|-w num] [-i] [-j jobs] [-?V] [file]");
+	puts("       mdchksum -b [-j jobs] [-o csv|json] [file ...]");
+	puts("       mdchksum -d file");
+	puts("       mdchksum -H [-j jobs] [-o csv|json] [file ...]");
 	puts("Read and write SEGA Genesis / Mega Drive ROM checksums.");
 	puts("");
+	puts("  -b     : verify many files, named as operands or on stdin.");
 	puts("  -c     : compute checksum.");
+	puts("  -d     : list blocks changed since the index was made.");
 	puts("  -f     : fix checksum.");
+	puts("  -H     : hash BIN, SMD and other images for DAT files.");
 	puts("  -i     : operate in-place.");
+	puts("  -j jobs: checksum with this many threads.");
+	puts("  -o fmt : write -b or -H results as csv (default) or json.");
 	puts("  -r     : read stored checksum.");
 	puts("  -w num : overwrite the checksum with num.");
+	puts("  -x     : keep a sidecar index to speed up later runs.");
 	puts("  -?     : display this message.");
 	puts("  -V     : display version information.");
 }
@@ -285,5 +1914,5 @@ print_help(void)
 static void
 print_version(void)
 {
-	puts("mdchksum 1.2");
+	puts("mdchksum 1.3");
 }
@@ -0,0 +1,41 @@
+#!/bin/sh
+# bench.sh: measure bin2hilo throughput, optionally against another build
+# usage: bench.sh [bin2hilo] [reference_bin2hilo] [megabits]
+#
+# A random BIN image of the given size (default 64 Mbit) is made by
+# mdbench (see ../../bench, or set MDBENCH) and split by each program,
+# and the best of five runs is reported.  If a reference program is
+# given (by default, any bin2hilo found in PATH), its output is also
+# checked to be identical.
+
+BIN2HILO=${1:-./bin2hilo}
+REFERENCE=${2:-$(command -v bin2hilo)}
+MBITS=${3:-64}
+MDBENCH=${MDBENCH:-$(dirname "$0")/../../bench/mdbench}
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/bin2hilo-bench.XXXXXX") || exit 1
+trap 'rm -rf "${WORK}"' EXIT INT TERM
+
+"${MDBENCH}" gen "${MBITS}" "${WORK}/in.bin" || exit 1
+SIZE=$(wc -c <"${WORK}/in.bin" | tr -d ' ')
+
+# time one program; print the best time in seconds
+best_of() {
+	set -- $("${MDBENCH}" run -n 5 "$1" "${WORK}/in.bin" "$2.hi" "$2.lo") \
+	|| exit 1
+	[ $# -eq 2 ] || exit 1
+	echo "$1"
+}
+
+report() {
+	echo "$1 $2 ${SIZE}" \
+	| awk '{ printf "%-40s %10.4f %10.1f\n", $1, $2, $3 / $2 / 1e6 }'
+}
+
+printf '%-40s %10s %10s\n' program seconds 'MB/s'
+report "${BIN2HILO}" "$(best_of "${BIN2HILO}" "${WORK}/out")"
+if [ -n "${REFERENCE}" ]; then
+	report "${REFERENCE}" "$(best_of "${REFERENCE}" "${WORK}/ref")"
+	{ cmp -s "${WORK}/out.hi" "${WORK}/ref.hi" \
+	  && cmp -s "${WORK}/out.lo" "${WORK}/ref.lo"; } \
+	|| echo "warning: output differs from ${REFERENCE}"
+fi
@@ -8,10 +8,15 @@
 #include <string.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+
+#include "split.h"
+#include "stats.h"
 
 #define PERR(str) fprintf(stderr, str)
 
-void bin2hilo(FILE*, FILE*, FILE*);
+int bin2hilo(int, int, int);
+int open_half(void*, unsigned long);
 void print_help();
 void print_license();
 
@@ -19,6 +24,7 @@ int
 main(int argc, char* argv[])
 {
 	int ch = 0, hflag = 0, lflag = 0;
+	rom_stats_start(argv[0]);
 	while ( (ch = getopt(argc, argv, "h?l")) != -1 )
 	{
 		switch (ch)
@@ -47,62 +53,64 @@ main(int argc, char* argv[])
 	{
 		if (argc == 3)
 		{
-			FILE *istream, *high_stream, *low_stream;
-			istream =	fopen(argv[0], "rb");
-			if (istream == NULL)
+			int ifile, high_file, low_file;
+			ifile = open(argv[0], O_RDONLY);
+			if (ifile == -1)
 			{
 				err(errno, "Could not open file %s", argv[0]);
 				return EXIT_FAILURE;
 			}
 
-			high_stream = fopen(argv[1], "wb");
-			if (high_stream == NULL)
+			high_file = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0666);
+			if (high_file == -1)
 			{
 				err(errno, "Could not open file %s", argv[1]);
-				fclose(istream);
+				close(ifile);
 				return EXIT_FAILURE;
 			}
 
-			low_stream = fopen(argv[2], "wb");
-			if (low_stream == NULL)
+			low_file = open(argv[2], O_RDWR | O_CREAT | O_TRUNC, 0666);
+			if (low_file == -1)
 			{
 				err(errno, "Could not open file %s", argv[2]);
-				fclose(istream);
-				fclose(high_stream);
+				close(ifile);
+				close(high_file);
 				return EXIT_FAILURE;
 			}
 
-			bin2hilo(istream, high_stream, low_stream);
-			fclose(istream);
-			fclose(high_stream);
-			fclose(low_stream);
+			if (bin2hilo(ifile, high_file, low_file) != 0)
+			{
+				err(errno, "Could not split %s", argv[0]);
+			}
+			close(ifile);
 		}
 	}
 	return EXIT_SUCCESS;
 }
 
-
-void
-bin2hilo(FILE *istream, FILE *high_stream, FILE* low_stream)
+
+/* Split the input into its high-order (even) and low-order (odd) bytes.
+ * This is the two-lane, unbanked case of the split engine,
+ * so an odd byte at the very end goes to the high-order file.
+ * Both outputs are closed.
+ */
+int
+bin2hilo(int ifile, int high_file, int low_file)
 {
-	char next_high, next_low;
-	
-	fseek(istream, 0, SEEK_SET);
-	fseek(high_stream, 0, SEEK_SET);
-	fseek(low_stream, 0, SEEK_SET);
-	next_high = fgetc(istream);
-	next_low = fgetc(istream);
-	while (!feof(istream) && !ferror(istream)
-	       && !ferror(high_stream) && !ferror(low_stream))
-	{
-		fputc(next_high, high_stream);
-		fputc(next_low, low_stream);
-		next_high = fgetc(istream);
-		next_low = fgetc(istream);
-	}
+	int halves[2];
+
+	halves[0] = high_file;
+	halves[1] = low_file;
+	return rom_split_fd(ifile, 2, 0, open_half, halves);
 }
 
-
+int
+open_half(void *context, unsigned long n)
+{
+	return ((int *)context)[n];
+}
+
+
 void
 print_help()
 {
@@ -8,11 +8,16 @@
 #include <string.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 
-#define HEADER_SIZE 0x200
+#include "rombuf.h"
+#include "smd.h"
+#include "stats.h"
+
+#define BLOCKS_PER_READ 16
 #define PERR(str) fprintf(stderr, str)
 
-void bin2smd(FILE*, FILE*);
+int bin2smd(int, int);
 void print_help();
 void print_license();
 
@@ -21,6 +26,7 @@ main(int argc, char* argv[])
 {
 	int ch = 0, hflag = 0, lflag = 0, oflag = 0;
 	char output_filename[256];
+	rom_stats_start(argv[0]);
 	while ( (ch = getopt(argc, argv, "h?lo:")) != -1 )
 	{
 		switch (ch)
@@ -59,87 +65,120 @@ main(int argc, char* argv[])
 	{
 		if (argc == 1 && oflag)
 		{
-			FILE *istream, *ostream;
-			istream =	fopen(argv[0], "rb");
-			if (istream == NULL)
+			int ifile, ofile;
+			ifile = (strcmp(argv[0], "-") == 0)
+				? STDIN_FILENO : open(argv[0], O_RDONLY);
+			if (ifile == -1)
 			{
 				err(errno, "Could not open file %s", argv[0]);
 				return EXIT_FAILURE;
 			}
 
-			ostream = fopen(output_filename, "wb");
-			if (ostream == NULL)
+			ofile = (strcmp(output_filename, "-") == 0)
+				? STDOUT_FILENO
+				: open(output_filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+			if (ofile == -1)
 			{
 				err(errno, "Could not open file %s", output_filename);
-				fclose(istream);
+				close(ifile);
 				return EXIT_FAILURE;
 			}
 
-			bin2smd(istream, ostream);
-			fclose(istream);
-			fclose(ostream);
+			if (bin2smd(ifile, ofile) != 0 || close(ofile) != 0)
+			{
+				err(errno, "Could not write %s", output_filename);
+			}
+			close(ifile);
 		}
 	}
 	return EXIT_SUCCESS;
 }
 
 
-void
-bin2smd(FILE *istream, FILE *ostream)
+/* The header of an SMD file (see smd.h) depends only on the size of
+ * the input, so it is written first, and then blocks are split
+ * straight from the input to the output in one forward pass,
+ * so either may be a pipe.
+ * A regular file is mapped and handled several blocks at a time,
+ * and the output is then given its full size and mapped as well;
+ * a pipe is read one block at a time.
+ * If the size of the input cannot be known in advance,
+ * the block count in the header is left as zero.
+ * Returns 0, or -1 with errno set.
+ */
+int
+bin2smd(int ifile, int ofile)
 {
-	ssize_t cpos = 0;
-	char next_char;
-	ssize_t i = 0;
+	struct rom_input in;
+	struct rom_output out;
+	unsigned char const *data;
+	unsigned char *dest;
+	size_t read_size = ROM_SMD_BLOCK_SIZE;
+	size_t nread;
+	off_t size;
+	int status = -1;
+	int saved;
 
-	fseek(istream, 1, SEEK_SET);
-	fseek(ostream, 0, SEEK_SET);
-	for (i = 0; i < HEADER_SIZE; ++i)
+	rom_input_open(&in, ifile);
+	size = rom_input_remaining(&in);
+	if (size >= 0)
 	{
-		fputc('\0', ostream);
+		read_size = BLOCKS_PER_READ * ROM_SMD_BLOCK_SIZE;
 	}
-
-	next_char = fgetc(istream);
-	while (!( feof(istream) ) && !( ferror(istream) )
-	       && !( ferror(ostream) ))
+	if (rom_output_open(&out, ofile, -1,
+	                    (size < 0) ? -1 : (off_t)(ROM_SMD_HEADER_SIZE
+	                                           + rom_smd_size(size)))
+	    != 0)
 	{
-		fputc(next_char, ostream);
-		++cpos;
-		if ((cpos / 8192) % 2 == 1)
-		{
-			ssize_t i;
-			cpos += 8192;
-			for (i = 0; i < 8192; ++i) fputc('\0', ostream);
-		}
-		fgetc(istream);
-		next_char = fgetc(istream);
+		rom_input_close(&in);
+		return -1;
 	}
+	/* on a pipe, hold no more than the block in hand */
+	rom_output_buffer(&out, ROM_SMD_BLOCK_SIZE);
+	dest = rom_output_next(&out, ROM_SMD_HEADER_SIZE);
+	if (dest == NULL)
+	{
+		goto done;
+	}
+	rom_smd_header(dest, (size < 0) ? 0 : size);
 
-	cpos = 8192;
-	fseek(istream, 0, SEEK_SET);
-	fseek(ostream, HEADER_SIZE + 8192, SEEK_SET);
-	next_char = fgetc(istream);
-	while (!( feof(istream) ) && !( ferror(istream) )
-	       && !( ferror(ostream) ))
+	for (;;)
 	{
-		fputc(next_char, ostream);
-		++cpos;
-		if ((cpos / 8192) % 2 == 0)
+		nread = rom_input_read(&in, &data, read_size);
+		if (nread == (size_t)-1)
+		{
+			goto done;
+		}
+		if (nread == 0)
+		{
+			break;
+		}
+		dest = rom_output_next(&out, rom_smd_size(nread));
+		if (dest == NULL)
 		{
-			cpos += 8192;
-			fseek(ostream, 8192, SEEK_CUR);
+			goto done;
+		}
+		rom_smd_encode(dest, data, nread);
+		if (nread < read_size)
+		{
+			break;
 		}
-		fgetc(istream);
-		next_char = fgetc(istream);
 	}
+	status = 0;
 
-	fseek(ostream, 0, SEEK_SET);
-	fputc((char)((cpos - 8192) / 16384), ostream);
-	fputc(0x03, ostream);
-	fseek(ostream, 8, SEEK_SET);
-	fputs("\xAA\xBB\x06", ostream);
+done:
+	saved = errno;
+	if (rom_output_close(&out) != 0 && status == 0)
+	{
+		saved = errno;
+		status = -1;
+	}
+	rom_input_close(&in);
+	errno = saved;
+	return status;
 }
 
-
+
 void
 print_help()
 {
@@ -148,8 +187,9 @@ print_help()
 	PERR("usage: bin2smd [-h?l] -o outfile infile\n\n");
 	PERR("  -h, -? : show this message\n");
 	PERR("  -l     : display license information\n");
-	PERR("  -o     : mandatory; followed by name of output file\n");
-	PERR("  infile : name of file to convert\n\n");
+	PERR("  -o     : mandatory; followed by name of output file,\n");
+	PERR("           or - for standard output\n");
+	PERR("  infile : name of file to convert, or - for standard input\n\n");
 }
 
 void
@@ -0,0 +1,37 @@
+#!/bin/sh
+# bench.sh: measure hilo2bin throughput and check that it undoes bin2hilo
+# usage: bench.sh [hilo2bin] [bin2hilo] [megabits]
+#
+# A random BIN image of the given size (default 64 Mbit) is made by
+# mdbench (see ../../bench, or set MDBENCH), split with bin2hilo (by
+# default ../bin2hilo/bin2hilo, or one found in PATH), joined again by
+# hilo2bin, and compared with the original.
+# The best of five runs of hilo2bin is reported.
+
+HILO2BIN=${1:-./hilo2bin}
+BIN2HILO=${2:-../bin2hilo/bin2hilo}
+[ -x "${BIN2HILO}" ] || BIN2HILO=$(command -v bin2hilo)
+MBITS=${3:-64}
+MDBENCH=${MDBENCH:-$(dirname "$0")/../../bench/mdbench}
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hilo2bin-bench.XXXXXX") || exit 1
+trap 'rm -rf "${WORK}"' EXIT INT TERM
+
+if [ -z "${BIN2HILO}" ]; then
+	echo "bench.sh: bin2hilo is needed to make the input" >&2
+	exit 1
+fi
+
+"${MDBENCH}" gen "${MBITS}" "${WORK}/in.bin" || exit 1
+SIZE=$(wc -c <"${WORK}/in.bin" | tr -d ' ')
+"${BIN2HILO}" "${WORK}/in.bin" "${WORK}/in.hi" "${WORK}/in.lo" || exit 1
+
+set -- $("${MDBENCH}" run -n 5 \
+         "${HILO2BIN}" "${WORK}/in.hi" "${WORK}/in.lo" "${WORK}/out.bin") \
+|| exit 1
+[ $# -eq 2 ] || exit 1
+
+printf '%-40s %10s %10s\n' program seconds 'MB/s'
+echo "${HILO2BIN} $1 ${SIZE}" \
+| awk '{ printf "%-40s %10.4f %10.1f\n", $1, $2, $3 / $2 / 1e6 }'
+cmp -s "${WORK}/in.bin" "${WORK}/out.bin" \
+|| echo "warning: output does not match the original image"
@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * hilo2bin: join high-order and low-order byte files into a BIN formatted rom
+ * See the function ``print_license'' below for license information.
+ ****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "split.h"
+#include "stats.h"
+
+#define PERR(str) fprintf(stderr, str)
+
+int hilo2bin(int, int, int);
+int open_half(void*, unsigned long);
+void print_help();
+void print_license();
+
+int
+main(int argc, char* argv[])
+{
+	int ch = 0, hflag = 0, lflag = 0;
+	rom_stats_start(argv[0]);
+	while ( (ch = getopt(argc, argv, "h?l")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'l':
+			lflag = 1;
+			break;
+		default:
+			hflag = 1;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (lflag)
+	{
+		print_license();
+	}
+
+	if (hflag || (!lflag && argc != 3))
+	{
+		print_help();
+	}
+	else
+	{
+		if (argc == 3)
+		{
+			int high_file, low_file, ofile;
+			high_file = open(argv[0], O_RDONLY);
+			if (high_file == -1)
+			{
+				err(errno, "Could not open file %s", argv[0]);
+				return EXIT_FAILURE;
+			}
+
+			low_file = open(argv[1], O_RDONLY);
+			if (low_file == -1)
+			{
+				err(errno, "Could not open file %s", argv[1]);
+				close(high_file);
+				return EXIT_FAILURE;
+			}
+
+			ofile = open(argv[2], O_RDWR | O_CREAT | O_TRUNC, 0666);
+			if (ofile == -1)
+			{
+				err(errno, "Could not open file %s", argv[2]);
+				close(high_file);
+				close(low_file);
+				return EXIT_FAILURE;
+			}
+
+			if (hilo2bin(high_file, low_file, ofile) != 0)
+			{
+				if (errno == EINVAL)
+				{
+					warnx("%s and %s differ in length", argv[0], argv[1]);
+					close(ofile);
+					return EXIT_FAILURE;
+				}
+				err(errno, "Could not write %s", argv[2]);
+			}
+			if (close(ofile) != 0)
+			{
+				err(errno, "Could not write %s", argv[2]);
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/* The inverse of bin2hilo: interleave the high-order and low-order bytes
+ * into the output.  The high-order file may be one byte longer than the
+ * low-order file, for a rom of odd length.  Returns nonzero with errno
+ * set to EINVAL if the lengths do not match up otherwise.
+ * Both inputs are closed.
+ */
+int
+hilo2bin(int high_file, int low_file, int ofile)
+{
+	int halves[2];
+
+	halves[0] = high_file;
+	halves[1] = low_file;
+	return rom_join_fd(ofile, 2, 0, open_half, halves);
+}
+
+int
+open_half(void *context, unsigned long n)
+{
+	return ((int *)context)[n];
+}
+
+
+void
+print_help()
+{
+	PERR("hilo2bin Copyright (c) 2026, Dakotah Lambert.\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: hilo2bin [-h?l] high_file low_file bin_file\n\n");
+	PERR("  -h, -?    : show this message\n");
+	PERR("  -l        : display license information\n");
+	PERR("  high_file : file of high-order bytes\n");
+	PERR("  low_file  : file of low-order bytes\n");
+	PERR("  bin_file  : output file, BIN / RAW formatted\n\n");
+}
+
+void
+print_license()
+{
+	PERR("\n hilo2bin\n\
+ Copyright (c) 2026, Dakotah Lambert\n\
+ All rights reserved.\n\
+\n\
+ Redistribution and use in source and binary forms, with or without\n\
+ modification, are permitted provided that the following conditions\n\
+ are met:\n\
+\n\
+ 1: Redistributions of source code must retain the above copyright\n\
+    notice, this list of conditions and the following disclaimer.\n\
+\n\
+ 2: Redistributions in binary form must reproduce the above copyright\n\
+    notice, this list of conditions and the following disclaimer in\n\
+    the documentation and/or other materials provided with the\n\
+    distribution.\n\
+\n\
+ 3: Neither the names of copyright holders nor the names of their\n\
+    contributors may be used to endors or promote products derived\n\
+    from this software without specific prior written permission.\n\
+\n\
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS\n\
+  \"AS IS\" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT\n\
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS\n\
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED, IN NO EVENT SHALL THE\n\
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,\n\
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,\n\
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;\n\
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER\n\
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT\n\
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN\n\
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE\n\
+  POSSIBILITY OF SUCH DAMAGE.\n\n");
+}
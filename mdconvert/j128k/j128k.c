@@ -0,0 +1,608 @@
+/*****************************************************************************
+ * j128k: join a rom split by s128k back together
+ * The pieces file.0, file.1, ... hold the even and odd bytes of each
+ * 256 kB window of the rom in turn:
+ * +---------+---------+
+ * | 0: Even | 1: Odd  |
+ * +---------+---------+
+ * | 2: Even | 3: Odd  |
+ * +---------+---------+
+ * |        ...        |
+ * +---------+---------+
+ * Windows are rebuilt concurrently, and the Genesis checksum and CRC-32
+ * of the result can be taken from the same pass.
+ * See the function ``print_license'' below for license information.
+ ****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "checksum.h"
+#include "rombuf.h"
+#include "split.h"
+#include "stats.h"
+
+#define kB * 1024
+#define BANK_SIZE (128 kB)
+#define PERR(str) fprintf(stderr, str)
+
+/* everything the workers share */
+struct join
+{
+	/* pieces, even then odd for each bank, and their sizes */
+	int *fds;
+	struct rom_input *ins;
+	off_t *sizes;
+	unsigned long nbanks;
+	size_t bank_size;
+	int ofd;
+	struct rom_output out;
+	/* the mapped output, which banks can fill out of order, or NULL */
+	unsigned char *map;
+	/* whether to compute checksums, and where the Genesis checksum stops */
+	int verify;
+	off_t sum_end;
+	/* per-bank Genesis checksum and CRC-32 */
+	unsigned int *sums;
+	uint32_t *crcs;
+	pthread_mutex_t lock;
+	pthread_cond_t turn;
+	/* next bank to rebuild, and next bank to write when not mapped */
+	unsigned long next_bank;
+	unsigned long next_write;
+	/* 0, or the errno that stopped the join */
+	int error;
+};
+
+int j128k(char const*, char const*, size_t, int, int);
+int open_pieces(char const*, struct join*);
+void *join_worker(void*);
+int pread_fully(int, unsigned char*, size_t, off_t);
+size_t parse_size(char const*);
+void print_help();
+void print_license();
+
+int
+main(int argc, char* argv[])
+{
+	int ch = 0, cflag = 0, hflag = 0, lflag = 0;
+	int jobs = 0;
+	size_t bank_size = BANK_SIZE;
+	char const *ofile = NULL;
+	rom_stats_start(argv[0]);
+	while ( (ch = getopt(argc, argv, "b:ch?j:lo:")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'b':
+			bank_size = parse_size(optarg);
+			if (bank_size == 0 || bank_size == (size_t)-1)
+			{
+				errx(EXIT_FAILURE, "Invalid bank size %s", optarg);
+			}
+			break;
+		case 'c':
+			cflag = 1;
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 1)
+			{
+				errx(EXIT_FAILURE, "Invalid job count %s", optarg);
+			}
+			break;
+		case 'l':
+			lflag = 1;
+			break;
+		case 'o':
+			ofile = optarg;
+			break;
+		default:
+			hflag = 1;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (lflag)
+	{
+		print_license();
+	}
+
+	if (hflag || (!lflag && argc != 1))
+	{
+		print_help();
+	}
+	else
+	{
+		if (argc == 1)
+		{
+			if (jobs == 0)
+			{
+				long n = sysconf(_SC_NPROCESSORS_ONLN);
+				jobs = (n > 0) ? n : 1;
+			}
+			return j128k(argv[0], ofile ? ofile : argv[0], bank_size, jobs,
+			             cflag);
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/* Rebuild `filename' from its pieces into `ofile' ("-" for the standard
+ * output), using `jobs' threads, each of which reads both pieces of a
+ * bank and interleaves them.  With `verify', each thread also sums its
+ * bank, and the sums are combined and printed at the end; the exit
+ * status is then a failure if the checksum disagrees with the header.
+ * Pieces that cannot be mapped are read a bank at a time.
+ */
+int
+j128k(char const* filename, char const* ofile, size_t bank_size, int jobs,
+      int verify)
+{
+	struct join join;
+	pthread_t *threads;
+	unsigned char header[ROM_HEADER_SIZE];
+	unsigned char *halves[2];
+	FILE *report;
+	unsigned long b;
+	unsigned int checksum = 0;
+	uint32_t crc = 0;
+	off_t total = 0, start;
+	size_t length;
+	int i, status = EXIT_SUCCESS;
+
+	memset(&join, 0, sizeof(join));
+	join.bank_size = bank_size;
+	join.verify = verify;
+	if (open_pieces(filename, &join) != 0)
+	{
+		return EXIT_FAILURE;
+	}
+	for (b = 0; b < 2 * join.nbanks; ++b)
+	{
+		total += join.sizes[b];
+	}
+
+	/* the header says where the checksum stops; with small banks it
+	 * spans several of them, and a short rom leaves the rest zero */
+	memset(header, 0, sizeof(header));
+	halves[0] = malloc(ROM_HEADER_SIZE);
+	if (halves[0] == NULL)
+	{
+		err(errno, "Could not allocate memory");
+	}
+	halves[1] = halves[0] + ROM_HEADER_SIZE / 2;
+	for (b = 0; b < join.nbanks
+	            && (off_t)b * 2 * bank_size < ROM_HEADER_SIZE; ++b)
+	{
+		start = (off_t)b * 2 * bank_size;
+		length = join.sizes[2 * b] + join.sizes[2 * b + 1];
+		if ((off_t)length > ROM_HEADER_SIZE - start)
+		{
+			length = ROM_HEADER_SIZE - start;
+		}
+		for (i = 0; i < 2; ++i)
+		{
+			if (pread_fully(join.fds[2 * b + i], halves[i],
+			                (length + 1 - i) / 2, 0) != 0)
+			{
+				err(errno, "Could not read %s.%lu", filename, 2 * b + i);
+			}
+		}
+		rom_interleave(header + start, (unsigned char const * const *)halves,
+		               length, 2);
+	}
+	free(halves[0]);
+	join.sum_end = rom_header_size(header);
+	if (join.sum_end > total)
+	{
+		join.sum_end = total;
+	}
+
+	if (strcmp(ofile, "-") == 0)
+	{
+		join.ofd = STDOUT_FILENO;
+	}
+	else
+	{
+		join.ofd = open(ofile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (join.ofd == -1)
+		{
+			err(errno, "Could not open file %s", ofile);
+		}
+	}
+	if (rom_output_open(&join.out, join.ofd, -1, total) != 0)
+	{
+		err(errno, "Could not reserve space for %s", ofile);
+	}
+	join.map = rom_output_map(&join.out);
+
+	join.sums = calloc(join.nbanks + 1, sizeof(*join.sums));
+	join.crcs = calloc(join.nbanks + 1, sizeof(*join.crcs));
+	threads = malloc(jobs * sizeof(*threads));
+	if (join.sums == NULL || join.crcs == NULL || threads == NULL)
+	{
+		err(errno, "Could not allocate memory");
+	}
+	pthread_mutex_init(&join.lock, NULL);
+	pthread_cond_init(&join.turn, NULL);
+	if ((unsigned long)jobs > join.nbanks)
+	{
+		jobs = (join.nbanks > 0) ? join.nbanks : 1;
+	}
+	for (i = 0; i < jobs; ++i)
+	{
+		if (pthread_create(threads + i, NULL, join_worker, &join) != 0)
+		{
+			break;
+		}
+	}
+	if (i == 0)
+	{
+		/* no threads to be had; do the work here */
+		join_worker(&join);
+	}
+	while (i-- > 0)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&join.lock);
+	pthread_cond_destroy(&join.turn);
+
+	if (join.error != 0)
+	{
+		errno = join.error;
+		err(errno, "Could not rebuild %s", ofile);
+	}
+	if (rom_output_close(&join.out) != 0
+	    || (join.ofd != STDOUT_FILENO && close(join.ofd) != 0))
+	{
+		err(errno, "Could not write %s", ofile);
+	}
+
+	if (verify)
+	{
+		/* banks start at even offsets, so their sums simply add */
+		for (b = 0; b < join.nbanks; ++b)
+		{
+			checksum = (checksum + join.sums[b]) % 65536;
+			crc = rom_crc32_combine(crc, join.crcs[b],
+			                        join.sizes[2 * b] + join.sizes[2 * b + 1]);
+		}
+		/* keep the report out of a rom written to standard output */
+		report = (join.ofd == STDOUT_FILENO) ? stderr : stdout;
+		fprintf(report, "checksum: 0x%04x (header 0x%04x)\n",
+		        checksum, rom_stored_checksum(header));
+		fprintf(report, "crc32:    %08lX\n", (unsigned long)crc);
+		if (checksum != rom_stored_checksum(header))
+		{
+			status = EXIT_FAILURE;
+		}
+	}
+
+	for (b = 0; b < 2 * join.nbanks; ++b)
+	{
+		close(join.fds[b]);
+	}
+	free(join.fds);
+	free(join.ins);
+	free(join.sizes);
+	free(join.sums);
+	free(join.crcs);
+	free(threads);
+	return status;
+}
+
+
+/* Open filename.0, filename.1, ... up to the first missing even piece,
+ * and check that their sizes fit together: every bank but the last is
+ * full, and in the last the odd piece is as long as the even one,
+ * or one byte shorter.
+ */
+int
+open_pieces(char const* filename, struct join* join)
+{
+	size_t length = strlen(filename) + 24;
+	char *name = malloc(length);
+	unsigned long n = 0;
+	struct stat st;
+	int fd;
+
+	if (name == NULL)
+	{
+		err(errno, "Could not allocate memory");
+	}
+	for (;; ++n)
+	{
+		snprintf(name, length, "%s.%lu", filename, n);
+		fd = open(name, O_RDONLY);
+		if (fd == -1 && errno == ENOENT && n > 0 && n % 2 == 0)
+		{
+			break;
+		}
+		if (fd == -1)
+		{
+			err(errno, "Could not open file %s", name);
+		}
+		if (fstat(fd, &st) != 0)
+		{
+			err(errno, "Could not read %s", name);
+		}
+		if (n % 2 == 0)
+		{
+			join->fds = realloc(join->fds, (n + 2) * sizeof(*join->fds));
+			join->ins = realloc(join->ins, (n + 2) * sizeof(*join->ins));
+			join->sizes = realloc(join->sizes, (n + 2) * sizeof(*join->sizes));
+			if (join->fds == NULL || join->ins == NULL || join->sizes == NULL)
+			{
+				err(errno, "Could not allocate memory");
+			}
+		}
+		join->fds[n] = fd;
+		join->sizes[n] = st.st_size;
+		rom_input_open(join->ins + n, fd);
+	}
+	join->nbanks = n / 2;
+	free(name);
+
+	for (n = 0; n < join->nbanks; ++n)
+	{
+		off_t even = join->sizes[2 * n];
+		off_t odd = join->sizes[2 * n + 1];
+		int last = (n + 1 == join->nbanks);
+		if ((!last && (even != (off_t)join->bank_size
+		               || odd != (off_t)join->bank_size))
+		    || (last && (even > (off_t)join->bank_size
+		                 || odd > even || odd + 1 < even)))
+		{
+			warnx("Pieces %s.%lu and %s.%lu do not fit together",
+			      filename, 2 * n, filename, 2 * n + 1);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/* Rebuild banks until there are none left: take the even and odd
+ * pieces of the bank, interleave them into its place in the output,
+ * and take their checksums.  Pieces are mapped where possible, and so
+ * is the output; an output that cannot be mapped is written in order,
+ * from a bank-sized buffer.
+ */
+void *
+join_worker(void *arg)
+{
+	struct join * const join = arg;
+	unsigned char const *in[2];
+	unsigned char *buffer = NULL;
+	unsigned char *out;
+	struct rom_checksum sum;
+	unsigned long b;
+	off_t start, end;
+	size_t length;
+	int error = 0;
+	int k;
+
+	if (join->map == NULL)
+	{
+		buffer = malloc(2 * join->bank_size);
+		if (buffer == NULL)
+		{
+			error = errno;
+		}
+	}
+
+	for (;;)
+	{
+		pthread_mutex_lock(&join->lock);
+		if (error != 0 && join->error == 0)
+		{
+			join->error = error;
+			pthread_cond_broadcast(&join->turn);
+		}
+		b = join->next_bank++;
+		if (join->error != 0 || b >= join->nbanks)
+		{
+			pthread_mutex_unlock(&join->lock);
+			break;
+		}
+		pthread_mutex_unlock(&join->lock);
+
+		for (k = 0; k < 2 && error == 0; ++k)
+		{
+			length = rom_input_read(join->ins + 2 * b + k, in + k,
+			                        join->sizes[2 * b + k]);
+			if (length == (size_t)-1)
+			{
+				error = errno;
+			}
+			else if (length != (size_t)join->sizes[2 * b + k])
+			{
+				/* the piece has shrunk since it was opened */
+				error = EIO;
+			}
+		}
+		if (error != 0)
+		{
+			continue;
+		}
+		length = join->sizes[2 * b] + join->sizes[2 * b + 1];
+		start = (off_t)b * 2 * join->bank_size;
+		out = (join->map != NULL) ? join->map + start : buffer;
+		rom_interleave(out, in, length, 2);
+
+		if (join->verify)
+		{
+			end = start + length;
+			rom_checksum_init(&sum, start);
+			if (start < join->sum_end)
+			{
+				rom_checksum_update(&sum, out,
+				                    ((end < join->sum_end) ? end : join->sum_end)
+				                    - start);
+			}
+			join->sums[b] = sum.sum;
+			join->crcs[b] = rom_crc32_update(0, out, length);
+		}
+		rom_input_close(join->ins + 2 * b);
+		rom_input_close(join->ins + 2 * b + 1);
+
+		if (join->map != NULL)
+		{
+			continue;
+		}
+		/* otherwise the banks go out in order */
+		pthread_mutex_lock(&join->lock);
+		while (join->next_write != b && join->error == 0)
+		{
+			pthread_cond_wait(&join->turn, &join->lock);
+		}
+		if (join->error == 0)
+		{
+			if (rom_output_write(&join->out, out, length) != 0)
+			{
+				error = errno;
+			}
+			++join->next_write;
+			pthread_cond_broadcast(&join->turn);
+		}
+		pthread_mutex_unlock(&join->lock);
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+
+int
+pread_fully(int fd, unsigned char* buffer, size_t size, off_t offset)
+{
+	size_t done = 0;
+	ssize_t got;
+
+	while (done < size)
+	{
+		got = pread(fd, buffer + done, size - done, offset + done);
+		if (got == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if (got == -1)
+		{
+			return -1;
+		}
+		if (got == 0)
+		{
+			/* the piece has shrunk since it was opened */
+			errno = EIO;
+			return -1;
+		}
+		done += got;
+	}
+	return 0;
+}
+
+/* A size is a number of bytes, optionally followed by k or M.
+ * Returns (size_t)-1 if it is not one.
+ */
+size_t
+parse_size(char const* str)
+{
+	unsigned long size;
+	char *end;
+
+	errno = 0;
+	size = strtoul(str, &end, 0);
+	if (errno != 0 || end == str)
+	{
+		return (size_t)-1;
+	}
+	switch (*end)
+	{
+	case 'k':
+	case 'K':
+		size *= 1024;
+		++end;
+		break;
+	case 'm':
+	case 'M':
+		size *= 1024 * 1024;
+		++end;
+		break;
+	}
+	if (*end != '\0')
+	{
+		return (size_t)-1;
+	}
+	return size;
+}
+
+
+void
+print_help()
+{
+	PERR("j128k Copyright (c) 2026, Dakotah Lambert.\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: j128k [-h?cl] [-b bank_size] [-j jobs] [-o outfile] infile\n\n");
+	PERR("  -h, -?       : show this message\n");
+	PERR("  -c           : print the Genesis checksum and CRC-32 of the rom,\n");
+	PERR("                 and fail if the checksum disagrees with the header\n");
+	PERR("  -l           : display license information\n");
+	PERR("  -b bank_size : bytes per piece, with optional k or M suffix\n");
+	PERR("                 (default 128k)\n");
+	PERR("  -j jobs      : number of banks to rebuild at once\n");
+	PERR("                 (default: one per processor)\n");
+	PERR("  -o outfile   : file to write, or - for the standard output\n");
+	PERR("                 (default: infile)\n");
+	PERR("  infile       : name of the rom that was split; its pieces are\n");
+	PERR("                 infile.0, infile.1, ...\n\n");
+}
+
+void
+print_license()
+{
+	PERR("\n j128k\n\
+ Copyright (c) 2026, Dakotah Lambert\n\
+ All rights reserved.\n\
+\n\
+ Redistribution and use in source and binary forms, with or without\n\
+ modification, are permitted provided that the following conditions\n\
+ are met:\n\
+\n\
+ 1: Redistributions of source code must retain the above copyright\n\
+    notice, this list of conditions and the following disclaimer.\n\
+\n\
+ 2: Redistributions in binary form must reproduce the above copyright\n\
+    notice, this list of conditions and the following disclaimer in\n\
+    the documentation and/or other materials provided with the\n\
+    distribution.\n\
+\n\
+ 3: Neither the names of copyright holders nor the names of their\n\
+    contributors may be used to endors or promote products derived\n\
+    from this software without specific prior written permission.\n\
+\n\
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS\n\
+  \"AS IS\" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT\n\
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS\n\
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED, IN NO EVENT SHALL THE\n\
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,\n\
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,\n\
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;\n\
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER\n\
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT\n\
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN\n\
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE\n\
+  POSSIBILITY OF SUCH DAMAGE.\n\n");
+}
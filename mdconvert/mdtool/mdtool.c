@@ -0,0 +1,1417 @@
+/*****************************************************************************
+ * mdtool: run a chain of conversions on a rom without leaving memory
+ * Each step works on the image left by the one before, so for instance
+ *   mdtool convert=bin pad=16 fix-checksum s128k game.smd
+ * reads game.smd once, and writes nothing but the s128k pieces.
+ * With -r, it instead tells the format of every rom under a directory.
+ * When run as mdconvert, it takes the arguments of the old mdconvert
+ * script instead.
+ * See the function ``print_license'' below for license information.
+ ****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "checksum.h"
+#include "detect.h"
+#include "pad.h"
+#include "rombuf.h"
+#include "smd.h"
+#include "split.h"
+#include "stats.h"
+
+#define FORMAT_BIN 0
+#define FORMAT_SMD 1
+#define S128K_BANK_SIZE 0x20000
+#define DEFAULT_PAD_SIZE 8
+#define DEFAULT_PAD_CHAR ((unsigned char) 0xFF)
+#define READ_CHUNK 0x10000
+#define MAX_STEPS 64
+#define PERR(str) fprintf(stderr, str)
+
+enum step_kind
+{
+	STEP_TYPE,
+	STEP_CONVERT,
+	STEP_PAD,
+	STEP_CHECKSUM,
+	STEP_FIX,
+	STEP_HILO,
+	STEP_S128K,
+	STEP_WRITE
+};
+
+struct step
+{
+	enum step_kind kind;
+	/* convert: the format wanted, or -1 for the other one */
+	int format;
+	/* pad */
+	size_t pad_to;
+	unsigned char pad_with;
+	/* hilo, s128k and write: output names, NULL for the default */
+	char const *names[2];
+};
+
+/* the rom as it stands between steps */
+struct image
+{
+	unsigned char *data;
+	size_t size;
+	int format;
+	/* what the input looked like, for the type step */
+	enum rom_format detected;
+	/* whether `data' belongs to us, or is the input's map */
+	int owned;
+	size_t capacity;
+	/* changed since it was last written out */
+	int dirty;
+};
+
+struct pipeline
+{
+	char const *input_name;
+	/* identity of the input, so that it is not overwritten while mapped */
+	struct stat input_stat;
+	int input_is_file;
+	char const *output_name;
+	/* name outputs from the first dot of the input's name, as the
+	 * mdconvert script did, rather than the last */
+	int first_dot;
+	struct image image;
+};
+
+/* paths still to be looked at by a scan, and the threads looking */
+struct scan
+{
+	char **stack;
+	size_t depth;
+	size_t capacity;
+	/* threads working on a path, which may yet add more */
+	int busy;
+	int failed;
+	pthread_mutex_t lock;
+	pthread_cond_t more;
+};
+
+int mdtool(int, char**);
+int mdconvert(int, char**);
+int parse_step(struct step*, char*);
+int run(struct pipeline*, struct step const*, int);
+int run_step(struct pipeline*, struct step const*);
+int load_image(struct pipeline*, struct rom_input*, int, int);
+void normalize_image(struct image*);
+int own_image(struct image*, size_t);
+int convert_image(struct image*, int);
+size_t checksum_end(struct image const*);
+size_t bin_size(struct image const*);
+int write_image(struct pipeline*, char const*);
+int split_image(struct pipeline*, size_t, char const* const*, unsigned long);
+int split_s128k(struct pipeline*, char const*);
+int create_file(struct pipeline*, char const*);
+char *base_name(char const*, char const*, int);
+int scan(char**, int, int);
+void *scan_worker(void*);
+int scan_push(struct scan*, char*);
+void scan_path(struct scan*, char*);
+void scan_file(struct scan*, char const*);
+void scan_fail(struct scan*);
+void print_field(char const*);
+void print_help();
+void print_mdconvert_help();
+void print_license();
+
+int
+main(int argc, char* argv[])
+{
+	char const *name = strrchr(argv[0], '/');
+
+	name = (name == NULL) ? argv[0] : name + 1;
+	if (strcmp(name, "mdconvert") == 0)
+	{
+		return mdconvert(argc, argv);
+	}
+	return mdtool(argc, argv);
+}
+
+
+int
+mdtool(int argc, char* argv[])
+{
+	struct pipeline pipeline;
+	struct step steps[MAX_STEPS];
+	int ch = 0, hflag = 0, lflag = 0, rflag = 0, format = -1;
+	long jobs = 0;
+	char *end;
+	int i;
+
+	pipeline.output_name = NULL;
+	pipeline.first_dot = 0;
+	rom_stats_start(argv[0]);
+	while ( (ch = getopt(argc, argv, "h?j:lo:rt:")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'j':
+			errno = 0;
+			jobs = strtol(optarg, &end, 10);
+			if (errno != 0 || end == optarg || *end != '\0' || jobs < 1
+			    || jobs > 1024)
+			{
+				errx(EXIT_FAILURE, "Invalid job count %s", optarg);
+			}
+			break;
+		case 'l':
+			lflag = 1;
+			break;
+		case 'r':
+			rflag = 1;
+			break;
+		case 'o':
+			pipeline.output_name = optarg;
+			break;
+		case 't':
+			if (strcasecmp(optarg, "bin") == 0)
+			{
+				format = FORMAT_BIN;
+			}
+			else if (strcasecmp(optarg, "smd") == 0)
+			{
+				format = FORMAT_SMD;
+			}
+			else
+			{
+				errx(EXIT_FAILURE, "Unknown rom type %s", optarg);
+			}
+			break;
+		default:
+			hflag = 1;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (lflag)
+	{
+		print_license();
+	}
+
+	if (hflag || (!lflag && argc < 1))
+	{
+		print_help();
+		return hflag ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (argc < 1)
+	{
+		return EXIT_SUCCESS;
+	}
+	if (rflag)
+	{
+		if (jobs == 0)
+		{
+			jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		return (scan(argv, argc, (jobs < 1) ? 1 : (int)jobs) == 0)
+			? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (argc - 1 > MAX_STEPS)
+	{
+		errx(EXIT_FAILURE, "At most %d steps can be chained", MAX_STEPS);
+	}
+
+	/* every step is checked before anything is read or written */
+	for (i = 0; i < argc - 1; ++i)
+	{
+		if (parse_step(&steps[i], argv[i]) != 0)
+		{
+			errx(EXIT_FAILURE, "Invalid step %s", argv[i]);
+		}
+	}
+	pipeline.input_name = argv[argc - 1];
+	pipeline.image.format = format;
+	return (run(&pipeline, steps, argc - 1) == 0)
+		? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* The interface of the old mdconvert script:
+ *   mdconvert ACTION FILE [OFILE1 ...]
+ * Each action is a one-step pipeline.
+ */
+int
+mdconvert(int argc, char* argv[])
+{
+	struct pipeline pipeline;
+	struct step step;
+
+	if (argc < 3)
+	{
+		print_mdconvert_help();
+		return EXIT_FAILURE;
+	}
+	pipeline.input_name = argv[2];
+	pipeline.output_name = NULL;
+	pipeline.first_dot = 1;
+	pipeline.image.format = -1;
+	step.names[0] = NULL;
+	step.names[1] = NULL;
+	if (strcmp(argv[1], "type") == 0)
+	{
+		step.kind = STEP_TYPE;
+	}
+	else if (strcmp(argv[1], "convert") == 0)
+	{
+		step.kind = STEP_CONVERT;
+		step.format = -1;
+		if (argc >= 4)
+		{
+			pipeline.output_name = argv[3];
+		}
+	}
+	else if (strcmp(argv[1], "hilo") == 0)
+	{
+		/* a single output name is ignored */
+		step.kind = STEP_HILO;
+		if (argc >= 5)
+		{
+			step.names[0] = argv[3];
+			step.names[1] = argv[4];
+		}
+	}
+	else if (strcmp(argv[1], "s128k") == 0)
+	{
+		step.kind = STEP_S128K;
+	}
+	else
+	{
+		warnx("Invalid command: %s", argv[1]);
+		print_mdconvert_help();
+		return EXIT_FAILURE;
+	}
+	return (run(&pipeline, &step, 1) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* A step is a name, optionally followed by = and its arguments:
+ *   type, convert[=bin|smd], pad[=MBITS[,BYTE]], checksum, fix-checksum,
+ *   hilo[=HIGH,LOW], s128k[=NAME], write=FILE
+ * `str' is cut up in place.  Returns 0, or -1 if it is not a step.
+ */
+int
+parse_step(struct step *step, char *str)
+{
+	char *equals = strchr(str, '=');
+	char *arg = NULL;
+	char *end;
+	unsigned long n;
+
+	if (equals != NULL)
+	{
+		*equals = '\0';
+		arg = equals + 1;
+	}
+	step->names[0] = NULL;
+	step->names[1] = NULL;
+	if (strcmp(str, "type") == 0 && arg == NULL)
+	{
+		step->kind = STEP_TYPE;
+	}
+	else if (strcmp(str, "convert") == 0)
+	{
+		step->kind = STEP_CONVERT;
+		step->format = -1;
+		if (arg != NULL)
+		{
+			if (strcasecmp(arg, "bin") == 0)
+			{
+				step->format = FORMAT_BIN;
+			}
+			else if (strcasecmp(arg, "smd") == 0)
+			{
+				step->format = FORMAT_SMD;
+			}
+			else
+			{
+				goto invalid;
+			}
+		}
+	}
+	else if (strcmp(str, "pad") == 0)
+	{
+		step->kind = STEP_PAD;
+		step->pad_to = DEFAULT_PAD_SIZE * ROM_MBIT;
+		step->pad_with = DEFAULT_PAD_CHAR;
+		if (arg != NULL)
+		{
+			errno = 0;
+			n = strtoul(arg, &end, 10);
+			if (errno != 0 || end == arg || n > (size_t)-1 / ROM_MBIT)
+			{
+				goto invalid;
+			}
+			step->pad_to = n * ROM_MBIT;
+			if (*end == ',')
+			{
+				arg = end + 1;
+				n = strtoul(arg, &end, 0);
+				if (end == arg || n > 0xFF)
+				{
+					goto invalid;
+				}
+				step->pad_with = (unsigned char)n;
+			}
+			if (*end != '\0')
+			{
+				goto invalid;
+			}
+		}
+	}
+	else if (strcmp(str, "checksum") == 0 && arg == NULL)
+	{
+		step->kind = STEP_CHECKSUM;
+	}
+	else if (strcmp(str, "fix-checksum") == 0 && arg == NULL)
+	{
+		step->kind = STEP_FIX;
+	}
+	else if (strcmp(str, "hilo") == 0)
+	{
+		step->kind = STEP_HILO;
+		if (arg != NULL)
+		{
+			end = strchr(arg, ',');
+			if (end == NULL || end == arg || end[1] == '\0')
+			{
+				goto invalid;
+			}
+			*end = '\0';
+			step->names[0] = arg;
+			step->names[1] = end + 1;
+		}
+	}
+	else if (strcmp(str, "s128k") == 0)
+	{
+		step->kind = STEP_S128K;
+		if (arg != NULL && *arg == '\0')
+		{
+			goto invalid;
+		}
+		step->names[0] = arg;
+	}
+	else if (strcmp(str, "write") == 0 && arg != NULL && *arg != '\0')
+	{
+		step->kind = STEP_WRITE;
+		step->names[0] = arg;
+	}
+	else
+	{
+		goto invalid;
+	}
+	return 0;
+
+invalid:
+	/* put the step back together for the error message */
+	if (equals != NULL)
+	{
+		*equals = '=';
+	}
+	return -1;
+}
+
+
+/* Read the input once, run each step on the image in memory, and
+ * write the image out at the end if the last steps changed it.
+ * Problems are reported here.  Returns 0, or -1 on failure.
+ */
+int
+run(struct pipeline *pipeline, struct step const *steps, int nsteps)
+{
+	struct image *image = &pipeline->image;
+	struct rom_input in;
+	char *name = NULL;
+	int fd, status = 0;
+	int i;
+
+	if (strcmp(pipeline->input_name, "-") == 0)
+	{
+		fd = STDIN_FILENO;
+	}
+	else
+	{
+		fd = open(pipeline->input_name, O_RDONLY);
+		if (fd == -1)
+		{
+			warn("Could not open file %s", pipeline->input_name);
+			return -1;
+		}
+	}
+	if (load_image(pipeline, &in, fd, image->format) != 0)
+	{
+		warn("Could not read %s", pipeline->input_name);
+		status = -1;
+	}
+
+	for (i = 0; i < nsteps && status == 0; ++i)
+	{
+		status = run_step(pipeline, &steps[i]);
+	}
+
+	if (status == 0 && image->dirty)
+	{
+		if (pipeline->output_name == NULL)
+		{
+			name = base_name(pipeline->input_name,
+			                 (image->format == FORMAT_BIN)
+			                 ? ".bin" : ".smd", pipeline->first_dot);
+		}
+		if (pipeline->output_name == NULL && name == NULL)
+		{
+			warn("Could not name the output");
+			status = -1;
+		}
+		else
+		{
+			status = write_image(pipeline,
+			                     (name != NULL) ? name
+			                     : pipeline->output_name);
+		}
+		free(name);
+	}
+
+	if (image->owned)
+	{
+		free(image->data);
+	}
+	rom_input_close(&in);
+	close(fd);
+	return status;
+}
+
+int
+run_step(struct pipeline *pipeline, struct step const *step)
+{
+	struct image *image = &pipeline->image;
+	char const *names[2];
+	char *defaults[2] = {NULL, NULL};
+	int status = 0;
+
+	/* pad and the checksum steps work on a BIN image;
+	 * the splits take an SMD image as it is */
+	if ((step->kind == STEP_PAD || step->kind == STEP_CHECKSUM
+	     || step->kind == STEP_FIX) && image->format != FORMAT_BIN
+	    && convert_image(image, FORMAT_BIN) != 0)
+	{
+		warn("Could not convert %s", pipeline->input_name);
+		return -1;
+	}
+
+	switch (step->kind)
+	{
+	case STEP_TYPE:
+		puts(rom_format_name(image->detected));
+		break;
+	case STEP_CONVERT:
+		if (convert_image(image, (step->format >= 0) ? step->format
+		                  : !image->format) != 0)
+		{
+			warn("Could not convert %s", pipeline->input_name);
+			return -1;
+		}
+		/* a swapped or padded rom is converted by loading it */
+		if (image->detected != ROM_FORMAT_BIN
+		    && image->detected != ROM_FORMAT_SMD)
+		{
+			image->detected = ROM_FORMAT_BIN;
+			image->dirty = 1;
+		}
+		break;
+	case STEP_PAD:
+		if (image->size >= step->pad_to)
+		{
+			break;
+		}
+		if (own_image(image, step->pad_to) != 0)
+		{
+			warn("Could not pad %s", pipeline->input_name);
+			return -1;
+		}
+		image->size = rom_pad(image->data, image->size, step->pad_to,
+		                      step->pad_with);
+		image->dirty = 1;
+		break;
+	case STEP_CHECKSUM:
+		printf("0x%04x\n", rom_calculate_checksum(image->data,
+		                                          checksum_end(image)));
+		break;
+	case STEP_FIX:
+		if (own_image(image, image->size) != 0)
+		{
+			warn("Could not fix the checksum of %s", pipeline->input_name);
+			return -1;
+		}
+		rom_fix_checksum(image->data, image->size,
+		                 rom_calculate_checksum(image->data,
+		                                        checksum_end(image)));
+		image->dirty = 1;
+		break;
+	case STEP_HILO:
+		names[0] = step->names[0];
+		names[1] = step->names[1];
+		if (names[0] == NULL && strcmp(pipeline->input_name, "-") == 0)
+		{
+			warnx("hilo needs names when reading standard input");
+			return -1;
+		}
+		if (names[0] == NULL)
+		{
+			names[0] = defaults[0] = base_name(pipeline->input_name, ".1",
+			                                   pipeline->first_dot);
+			names[1] = defaults[1] = base_name(pipeline->input_name, ".2",
+			                                   pipeline->first_dot);
+		}
+		if (names[0] == NULL || names[1] == NULL)
+		{
+			warn("Could not name the output");
+			status = -1;
+		}
+		else
+		{
+			status = split_image(pipeline, 0, names, 2);
+		}
+		free(defaults[0]);
+		free(defaults[1]);
+		return status;
+	case STEP_S128K:
+		return split_s128k(pipeline, (step->names[0] != NULL)
+		                   ? step->names[0] : pipeline->input_name);
+	case STEP_WRITE:
+		return write_image(pipeline, step->names[0]);
+	}
+	return status;
+}
+
+
+/* The whole input becomes the first image.  A regular file is mapped
+ * and used in place until a step needs to change it; anything else is
+ * read into memory.  Unless `format' says otherwise, its format is
+ * detected (see detect.h), and one that is neither BIN nor SMD is made
+ * BIN; a rom with no signature at all is taken to be SMD, as the
+ * mdconvert script took it.
+ * Returns 0, or -1 with errno set.
+ */
+int
+load_image(struct pipeline *pipeline, struct rom_input *in, int fd,
+           int format)
+{
+	struct image *image = &pipeline->image;
+	unsigned char const *data;
+	off_t remaining;
+	size_t n;
+
+	image->data = NULL;
+	image->size = 0;
+	image->owned = 0;
+	image->capacity = 0;
+	image->dirty = 0;
+	pipeline->input_is_file = (fstat(fd, &pipeline->input_stat) == 0
+	                           && S_ISREG(pipeline->input_stat.st_mode));
+	if (rom_input_open(in, fd) != 0)
+	{
+		return -1;
+	}
+	remaining = rom_input_remaining(in);
+	if (remaining >= 0)
+	{
+		n = rom_input_read(in, &data, remaining);
+		if (n == (size_t)-1)
+		{
+			return -1;
+		}
+		image->data = (unsigned char *)data;
+		image->size = n;
+	}
+	else
+	{
+		do
+		{
+			if (own_image(image, image->size + READ_CHUNK) != 0)
+			{
+				return -1;
+			}
+			n = rom_input_read(in, &data, READ_CHUNK);
+			if (n == (size_t)-1)
+			{
+				return -1;
+			}
+			memcpy(image->data + image->size, data, n);
+			image->size += n;
+		} while (n > 0);
+	}
+	if (format >= 0)
+	{
+		image->format = format;
+		image->detected = (format == FORMAT_BIN)
+			? ROM_FORMAT_BIN : ROM_FORMAT_SMD;
+		return 0;
+	}
+	image->detected = rom_detect(image->data, image->size, image->size, NULL);
+	if (image->detected == ROM_FORMAT_SWAPPED && own_image(image, 0) != 0)
+	{
+		return -1;
+	}
+	normalize_image(image);
+	return 0;
+}
+
+/* Bring a detected image to BIN or SMD.  A swapped image must be ours.
+ * A padded one loses its header: a map is simply looked at past it.
+ * Neither counts as a change until a step is run on it.
+ */
+void
+normalize_image(struct image *image)
+{
+	unsigned char t;
+	size_t i;
+
+	image->format = FORMAT_BIN;
+	switch (image->detected)
+	{
+	case ROM_FORMAT_UNKNOWN:
+		image->detected = ROM_FORMAT_SMD;
+		image->format = FORMAT_SMD;
+		break;
+	case ROM_FORMAT_SMD:
+		image->format = FORMAT_SMD;
+		break;
+	case ROM_FORMAT_SWAPPED:
+		for (i = 0; i + 1 < image->size; i += 2)
+		{
+			t = image->data[i];
+			image->data[i] = image->data[i + 1];
+			image->data[i + 1] = t;
+		}
+		break;
+	case ROM_FORMAT_PADDED:
+		image->size -= ROM_SMD_HEADER_SIZE;
+		if (image->owned)
+		{
+			memmove(image->data, image->data + ROM_SMD_HEADER_SIZE,
+			        image->size);
+		}
+		else
+		{
+			image->data += ROM_SMD_HEADER_SIZE;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+
+/* Make the image ours to change, with room for `capacity' bytes.
+ * Returns 0, or -1 with errno set.
+ */
+int
+own_image(struct image *image, size_t capacity)
+{
+	unsigned char *data;
+
+	if (image->owned && image->capacity >= capacity)
+	{
+		return 0;
+	}
+	if (capacity < image->size)
+	{
+		capacity = image->size;
+	}
+	if (image->owned)
+	{
+		/* grow geometrically, as a pipe is read a chunk at a time */
+		if (capacity < 2 * image->capacity)
+		{
+			capacity = 2 * image->capacity;
+		}
+		data = realloc(image->data, capacity ? capacity : 1);
+	}
+	else
+	{
+		data = malloc(capacity ? capacity : 1);
+		if (data != NULL && image->size > 0)
+		{
+			memcpy(data, image->data, image->size);
+		}
+	}
+	if (data == NULL)
+	{
+		return -1;
+	}
+	image->data = data;
+	image->owned = 1;
+	image->capacity = capacity;
+	return 0;
+}
+
+/* Convert the image to `format' in a new buffer.
+ * Returns 0, or -1 with errno set.
+ */
+int
+convert_image(struct image *image, int format)
+{
+	unsigned char *data;
+	size_t size;
+
+	if (image->format == format)
+	{
+		return 0;
+	}
+	if (format == FORMAT_BIN)
+	{
+		size = (image->size < ROM_SMD_HEADER_SIZE)
+			? 0 : rom_bin_size(image->size - ROM_SMD_HEADER_SIZE);
+	}
+	else
+	{
+		size = ROM_SMD_HEADER_SIZE + rom_smd_size(image->size);
+	}
+	data = malloc(size ? size : 1);
+	if (data == NULL)
+	{
+		return -1;
+	}
+	if (format == FORMAT_BIN)
+	{
+		if (size > 0)
+		{
+			rom_smd_decode(data, image->data + ROM_SMD_HEADER_SIZE,
+			               image->size - ROM_SMD_HEADER_SIZE);
+		}
+	}
+	else
+	{
+		rom_smd_header(data, image->size);
+		rom_smd_encode(data + ROM_SMD_HEADER_SIZE, image->data, image->size);
+	}
+	if (image->owned)
+	{
+		free(image->data);
+	}
+	image->data = data;
+	image->size = size;
+	image->format = format;
+	image->detected = (format == FORMAT_BIN) ? ROM_FORMAT_BIN : ROM_FORMAT_SMD;
+	image->owned = 1;
+	image->capacity = size;
+	image->dirty = 1;
+	return 0;
+}
+
+/* Size of the BIN rom the image holds */
+size_t
+bin_size(struct image const *image)
+{
+	if (image->format == FORMAT_BIN)
+	{
+		return image->size;
+	}
+	return (image->size < ROM_SMD_HEADER_SIZE)
+		? 0 : rom_bin_size(image->size - ROM_SMD_HEADER_SIZE);
+}
+
+/* The checksum runs to the rom size in the header, as mdchksum's does,
+ * but never past the end of the image.
+ */
+size_t
+checksum_end(struct image const *image)
+{
+	unsigned long end;
+
+	if (image->size < ROM_HEADER_SIZE)
+	{
+		return image->size;
+	}
+	end = rom_header_size(image->data);
+	return (end < image->size) ? end : image->size;
+}
+
+
+/* Write the image to `name', or - for standard output.
+ * Problems are reported here.  Returns 0, or -1 on failure.
+ */
+int
+write_image(struct pipeline *pipeline, char const *name)
+{
+	struct image *image = &pipeline->image;
+	struct rom_output out;
+	int fd;
+
+	fd = create_file(pipeline, name);
+	if (fd == -1)
+	{
+		return -1;
+	}
+	if (rom_output_open(&out, fd, -1, image->size) != 0
+	    || rom_output_write(&out, image->data, image->size) != 0
+	    || rom_output_close(&out) != 0
+	    || (fd != STDOUT_FILENO && close(fd) != 0))
+	{
+		warn("Could not write %s", name);
+		if (fd != STDOUT_FILENO)
+		{
+			close(fd);
+		}
+		return -1;
+	}
+	image->dirty = 0;
+	return 0;
+}
+
+/* Split the image into two byte lanes, cut into banks of `bank_size'
+ * bytes (or left whole, if 0), and write the `npieces' pieces to
+ * `names'.  Every piece is given its full size and mapped before the
+ * split runs straight into them.  An SMD image is split from its blocks,
+ * whose halves are already the two lanes, without converting it.
+ * Problems are reported here.  Returns 0, or -1 on failure.
+ */
+int
+split_image(struct pipeline *pipeline, size_t bank_size,
+            char const * const *names, unsigned long npieces)
+{
+	struct image *image = &pipeline->image;
+	struct rom_output *outs;
+	unsigned char **dest;
+	int *fds;
+	off_t size;
+	unsigned long i, opened = 0;
+	int status = -1;
+
+	outs = malloc((npieces + 1) * sizeof(*outs));
+	dest = malloc((npieces + 1) * sizeof(*dest));
+	fds = malloc((npieces + 1) * sizeof(*fds));
+	if (outs == NULL || dest == NULL || fds == NULL)
+	{
+		warn("Could not split %s", pipeline->input_name);
+		goto done;
+	}
+	for (opened = 0; opened < npieces; ++opened)
+	{
+		size = rom_piece_size(bin_size(image), 2, bank_size, opened);
+		fds[opened] = create_file(pipeline, names[opened]);
+		if (fds[opened] == -1)
+		{
+			goto done;
+		}
+		if (rom_output_open(&outs[opened], fds[opened], -1, size) != 0)
+		{
+			warn("Could not write %s", names[opened]);
+			close(fds[opened]);
+			goto done;
+		}
+		dest[opened] = rom_output_next(&outs[opened], size);
+		if (dest[opened] == NULL)
+		{
+			warn("Could not write %s", names[opened]);
+			++opened;
+			goto done;
+		}
+	}
+	if (image->format == FORMAT_BIN)
+	{
+		rom_split_buffer(dest, image->data, image->size, 2, bank_size);
+	}
+	else if (image->size > ROM_SMD_HEADER_SIZE)
+	{
+		rom_smd_split(dest, image->data + ROM_SMD_HEADER_SIZE,
+		              image->size - ROM_SMD_HEADER_SIZE, bank_size);
+	}
+	status = 0;
+	image->dirty = 0;
+
+done:
+	for (i = 0; i < opened; ++i)
+	{
+		if ((rom_output_close(&outs[i]) != 0 || close(fds[i]) != 0)
+		    && status == 0)
+		{
+			warn("Could not write %s", names[i]);
+			status = -1;
+		}
+	}
+	free(outs);
+	free(dest);
+	free(fds);
+	return status;
+}
+
+/* Split the image as s128k does, into `prefix.0', `prefix.1', ...
+ * Problems are reported here.  Returns 0, or -1 on failure.
+ */
+int
+split_s128k(struct pipeline *pipeline, char const *prefix)
+{
+	unsigned long npieces, i;
+	size_t length;
+	char const **names;
+	char *buffer;
+	int status;
+
+	if (strcmp(prefix, "-") == 0)
+	{
+		warnx("s128k needs a name when reading standard input");
+		return -1;
+	}
+	npieces = rom_split_pieces(bin_size(&pipeline->image), 2,
+	                           S128K_BANK_SIZE);
+	length = strlen(prefix) + 24;
+	names = malloc((npieces + 1) * sizeof(*names));
+	buffer = malloc(npieces * length + 1);
+	if (names == NULL || buffer == NULL)
+	{
+		warn("Could not split %s", pipeline->input_name);
+		free(names);
+		free(buffer);
+		return -1;
+	}
+	for (i = 0; i < npieces; ++i)
+	{
+		names[i] = buffer + i * length;
+		snprintf(buffer + i * length, length, "%s.%lu", prefix, i);
+	}
+	status = split_image(pipeline, S128K_BANK_SIZE, names, npieces);
+	free(names);
+	free(buffer);
+	return status;
+}
+
+/* Open `name' for writing, or standard output for -.
+ * If it is the input itself, the image is copied out of the input's
+ * map before the file is truncated from under it.
+ * Problems are reported here.  Returns a descriptor, or -1.
+ */
+int
+create_file(struct pipeline *pipeline, char const *name)
+{
+	struct stat st;
+	int fd;
+
+	if (strcmp(name, "-") == 0)
+	{
+		return STDOUT_FILENO;
+	}
+	if (pipeline->input_is_file && !pipeline->image.owned
+	    && stat(name, &st) == 0
+	    && st.st_dev == pipeline->input_stat.st_dev
+	    && st.st_ino == pipeline->input_stat.st_ino
+	    && own_image(&pipeline->image, pipeline->image.size) != 0)
+	{
+		warn("Could not write %s", name);
+		return -1;
+	}
+	fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+	{
+		warn("Could not open file %s", name);
+	}
+	return fd;
+}
+
+/* `path' with its extension replaced by `suffix', in a new string;
+ * standard input becomes standard output.  NULL if out of memory.
+ * The extension starts at the last dot of the file name, or the first
+ * if `first_dot' is set, so that game.v1.smd becomes game.bin.  A dot
+ * that starts the name does not count.
+ */
+char *
+base_name(char const *path, char const *suffix, int first_dot)
+{
+	char const *slash = strrchr(path, '/');
+	char const *file = (slash == NULL) ? path : slash + 1;
+	char const *dot = (*file == '\0') ? NULL
+		: first_dot ? strchr(file + 1, '.') : strrchr(file + 1, '.');
+	size_t length = strlen(path);
+	char *name;
+
+	if (strcmp(path, "-") == 0)
+	{
+		return strdup("-");
+	}
+	if (dot != NULL)
+	{
+		length = dot - path;
+	}
+	name = malloc(length + strlen(suffix) + 1);
+	if (name != NULL)
+	{
+		memcpy(name, path, length);
+		strcpy(name + length, suffix);
+	}
+	return name;
+}
+
+
+/* Print the format of every rom in `paths', looking through directories
+ * recursively, as CSV.  `jobs' threads share a stack of paths still to
+ * be looked at, and each prints a line as it finishes a file.  Only the
+ * first ROM_DETECT_SIZE bytes of a file are read.  Symbolic links are
+ * not followed, so that a tree is never walked twice.
+ * Problems are reported here.  Returns 0, or -1 if any file could not
+ * be read.
+ */
+int
+scan(char **paths, int npaths, int jobs)
+{
+	struct scan scan;
+	pthread_t *threads;
+	int nthreads = 0;
+	int i;
+
+	scan.stack = NULL;
+	scan.depth = 0;
+	scan.capacity = 0;
+	scan.busy = 0;
+	scan.failed = 0;
+	if (pthread_mutex_init(&scan.lock, NULL) != 0
+	    || pthread_cond_init(&scan.more, NULL) != 0)
+	{
+		warnx("Could not start the scan");
+		return -1;
+	}
+	/* the first path given is the first looked at */
+	for (i = npaths - 1; i >= 0; --i)
+	{
+		scan_push(&scan, strdup(paths[i]));
+	}
+	puts("path,format,score");
+
+	threads = calloc(jobs, sizeof(*threads));
+	if (threads != NULL)
+	{
+		while (nthreads < jobs - 1
+		       && pthread_create(&threads[nthreads], NULL,
+		                         scan_worker, &scan) == 0)
+		{
+			++nthreads;
+		}
+	}
+	scan_worker(&scan);
+	for (i = 0; i < nthreads; ++i)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(scan.stack);
+	pthread_cond_destroy(&scan.more);
+	pthread_mutex_destroy(&scan.lock);
+
+	if (fflush(stdout) != 0)
+	{
+		warn("Could not write the results");
+		return -1;
+	}
+	return scan.failed ? -1 : 0;
+}
+
+/* Take paths off the stack until it is empty and no other thread
+ * can add to it.
+ */
+void *
+scan_worker(void *arg)
+{
+	struct scan *scan = arg;
+	char *path;
+
+	pthread_mutex_lock(&scan->lock);
+	for (;;)
+	{
+		while (scan->depth == 0 && scan->busy > 0)
+		{
+			pthread_cond_wait(&scan->more, &scan->lock);
+		}
+		if (scan->depth == 0)
+		{
+			break;
+		}
+		path = scan->stack[--scan->depth];
+		++scan->busy;
+		pthread_mutex_unlock(&scan->lock);
+
+		scan_path(scan, path);
+		free(path);
+
+		pthread_mutex_lock(&scan->lock);
+		if (--scan->busy == 0 && scan->depth == 0)
+		{
+			/* nothing more will come; let the others finish */
+			pthread_cond_broadcast(&scan->more);
+		}
+	}
+	pthread_mutex_unlock(&scan->lock);
+	return NULL;
+}
+
+/* Add `path', a string the scan now owns, to the stack.
+ * Called with the lock not held.  Returns 0, or -1 with errno set.
+ */
+int
+scan_push(struct scan *scan, char *path)
+{
+	char **stack;
+	size_t capacity;
+
+	if (path == NULL)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&scan->lock);
+	if (scan->depth == scan->capacity)
+	{
+		capacity = scan->capacity ? 2 * scan->capacity : 64;
+		stack = realloc(scan->stack, capacity * sizeof(*stack));
+		if (stack == NULL)
+		{
+			pthread_mutex_unlock(&scan->lock);
+			free(path);
+			errno = ENOMEM;
+			return -1;
+		}
+		scan->stack = stack;
+		scan->capacity = capacity;
+	}
+	scan->stack[scan->depth++] = path;
+	pthread_cond_signal(&scan->more);
+	pthread_mutex_unlock(&scan->lock);
+	return 0;
+}
+
+/* Classify the file `path', or push the contents of the directory */
+void
+scan_path(struct scan *scan, char *path)
+{
+	struct stat st;
+	struct dirent *entry;
+	DIR *dir;
+	size_t length;
+	char *child;
+
+	if (lstat(path, &st) != 0)
+	{
+		warn("Could not open file %s", path);
+		scan_fail(scan);
+		return;
+	}
+	if (S_ISREG(st.st_mode))
+	{
+		scan_file(scan, path);
+		return;
+	}
+	if (!S_ISDIR(st.st_mode))
+	{
+		return;
+	}
+
+	dir = opendir(path);
+	if (dir == NULL)
+	{
+		warn("Could not open directory %s", path);
+		scan_fail(scan);
+		return;
+	}
+	length = strlen(path);
+	while (length > 1 && path[length - 1] == '/')
+	{
+		path[--length] = '\0';
+	}
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (strcmp(entry->d_name, ".") == 0
+		    || strcmp(entry->d_name, "..") == 0)
+		{
+			continue;
+		}
+		child = malloc(length + strlen(entry->d_name) + 2);
+		if (child != NULL)
+		{
+			sprintf(child, "%s%s%s", path,
+			        (path[length - 1] == '/') ? "" : "/", entry->d_name);
+		}
+		if (scan_push(scan, child) != 0)
+		{
+			warn("Could not scan %s", path);
+			scan_fail(scan);
+			break;
+		}
+	}
+	closedir(dir);
+}
+
+/* Read the head of the file `path' and print what it holds */
+void
+scan_file(struct scan *scan, char const *path)
+{
+	unsigned char head[ROM_DETECT_SIZE];
+	struct stat st;
+	enum rom_format format = ROM_FORMAT_UNKNOWN;
+	ssize_t n = -1;
+	int score = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd != -1)
+	{
+		if (fstat(fd, &st) == 0)
+		{
+			n = pread(fd, head, sizeof(head), 0);
+		}
+		close(fd);
+	}
+	if (n >= 0)
+	{
+		format = rom_detect(head, n, st.st_size, &score);
+	}
+
+	pthread_mutex_lock(&scan->lock);
+	print_field(path);
+	if (n >= 0)
+	{
+		printf(",%s,%d\n", rom_format_name(format), score);
+	}
+	else
+	{
+		fputs(",unreadable,\n", stdout);
+		scan->failed = 1;
+	}
+	pthread_mutex_unlock(&scan->lock);
+}
+
+void
+scan_fail(struct scan *scan)
+{
+	pthread_mutex_lock(&scan->lock);
+	scan->failed = 1;
+	pthread_mutex_unlock(&scan->lock);
+}
+
+/* Print a string for CSV, quoted only where it has to be */
+void
+print_field(char const *str)
+{
+	if (strpbrk(str, ",\"\r\n") == NULL)
+	{
+		fputs(str, stdout);
+		return;
+	}
+	putchar('"');
+	for (; *str != '\0'; ++str)
+	{
+		if (*str == '"')
+		{
+			putchar('"');
+		}
+		putchar(*str);
+	}
+	putchar('"');
+}
+
+
+void
+print_help()
+{
+	PERR("mdtool Copyright (c) 2026, Dakotah Lambert.\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: mdtool [-h?l] [-t bin|smd] [-o outfile] step ... infile\n");
+	PERR("       mdtool -r [-j jobs] path ...\n\n");
+	PERR("  -h, -?  : show this message\n");
+	PERR("  -l      : display license information\n");
+	PERR("  -r      : print the format of every file under each path\n");
+	PERR("            as CSV, without following symbolic links\n");
+	PERR("  -j      : with -r, scan with this many threads\n");
+	PERR("            (default: one per processor)\n");
+	PERR("  -t      : treat infile as BIN or SMD rather than detecting it\n");
+	PERR("  -o      : where to write the image if the last steps change it;\n");
+	PERR("            by default, infile with the extension .bin or .smd\n");
+	PERR("  infile  : rom to work on, or - for standard input\n\n");
+	PERR("  Each step works on the image left by the one before,\n");
+	PERR("  in memory.  pad and the checksum steps turn an SMD image\n");
+	PERR("  into BIN first; hilo and s128k split it as it is.\n");
+	PERR("    type                : print BIN, SMD, SWAPPED (bytes of each\n");
+	PERR("                          word swapped) or PADDED (BIN behind a\n");
+	PERR("                          512-byte header); the last two are\n");
+	PERR("                          worked on as BIN\n");
+	PERR("    convert[=bin|smd]   : convert to the other (or given) format\n");
+	PERR("    pad[=MBITS[,BYTE]]  : pad to MBITS megabits (default 8)\n");
+	PERR("                          with BYTE (default 0xFF)\n");
+	PERR("    checksum            : print the checksum the rom should have\n");
+	PERR("    fix-checksum        : store that checksum in the header\n");
+	PERR("    hilo[=HIGH,LOW]     : write the even and odd bytes to HIGH\n");
+	PERR("                          and LOW (default infile.1, infile.2)\n");
+	PERR("    s128k[=NAME]        : write Megabit even / odd pieces to\n");
+	PERR("                          NAME.0, NAME.1, ... (default infile)\n");
+	PERR("    write=FILE          : write the image to FILE, or -\n\n");
+}
+
+void
+print_mdconvert_help()
+{
+	PERR("mdconvert Copyright (c) 2014, Dakotah Lambert\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: mdconvert ACTION FILE [OFILE1 ...]\n");
+	PERR("  ACTION can be any of:\n");
+	PERR("    convert: If a file is BIN formatted, convert it to SMD;\n");
+	PERR("             if it is SMD formatted, convert it to BIN.\n");
+	PERR("             Optional one output file name.\n\n");
+	PERR("    hilo: Split a rom to even / odd byte files.\n");
+	PERR("          Optional two output file names. If only one is\n");
+	PERR("          specified, it is ignored.\n\n");
+	PERR("    s128k: Split a rom to Megabit-sized even / odd byte files.\n");
+	PERR("           Requires no output file names.\n\n");
+	PERR("    type: Determine the formatting of the rom.\n");
+	PERR("          Requires no output file names.\n\n");
+	PERR("  mdconvert is mdtool under another name; see mdtool -h\n");
+	PERR("  for chaining several of these in one run.\n\n");
+}
+
+void
+print_license()
+{
+	PERR("\n mdtool\n\
+ Copyright (c) 2026, Dakotah Lambert\n\
+ All rights reserved.\n\
+\n\
+ Redistribution and use in source and binary forms, with or without\n\
+ modification, are permitted provided that the following conditions\n\
+ are met:\n\
+\n\
+ 1: Redistributions of source code must retain the above copyright\n\
+    notice, this list of conditions and the following disclaimer.\n\
+\n\
+ 2: Redistributions in binary form must reproduce the above copyright\n\
+    notice, this list of conditions and the following disclaimer in\n\
+    the documentation and/or other materials provided with the\n\
+    distribution.\n\
+\n\
+ 3: Neither the names of copyright holders nor the names of their\n\
+    contributors may be used to endors or promote products derived\n\
+    from this software without specific prior written permission.\n\
+\n\
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS\n\
+  \"AS IS\" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT\n\
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS\n\
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED, IN NO EVENT SHALL THE\n\
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,\n\
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,\n\
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;\n\
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER\n\
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT\n\
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN\n\
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE\n\
+  POSSIBILITY OF SUCH DAMAGE.\n\n");
+}
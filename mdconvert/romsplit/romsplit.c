@@ -0,0 +1,250 @@
+/*****************************************************************************
+ * romsplit: split a rom among several EPROMs, or join it back together
+ * The rom is split into byte lanes, and each lane into banks:
+ * with -n 4 -b 512k, piece 0 holds bytes 0, 4, 8, ... of the first 2 MB,
+ * pieces 1 to 3 hold the bytes after them, piece 4 starts the next 2 MB,
+ * and so on.  s128k is -n 2 -b 128k, and bin2hilo is -n 2 -b 0.
+ * See the function ``print_license'' below for license information.
+ ****************************************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "split.h"
+#include "stats.h"
+
+#define PERR(str) fprintf(stderr, str)
+
+struct piece_names
+{
+	char const *filename;
+	char *buffer;
+	size_t length;
+	int flags;
+};
+
+int romsplit(char const*, unsigned, size_t, int);
+int open_piece(void*, unsigned long);
+size_t parse_size(char const*);
+void print_help();
+void print_license();
+
+int
+main(int argc, char* argv[])
+{
+	int ch = 0, hflag = 0, jflag = 0, lflag = 0;
+	unsigned long lanes = 2;
+	size_t bank_size = 0;
+	char *end;
+	rom_stats_start(argv[0]);
+	while ( (ch = getopt(argc, argv, "b:h?jln:")) != -1 )
+	{
+		switch (ch)
+		{
+		case 'b':
+			bank_size = parse_size(optarg);
+			if (bank_size == (size_t)-1)
+			{
+				errx(EXIT_FAILURE, "Invalid bank size %s", optarg);
+			}
+			break;
+		case 'j':
+			jflag = 1;
+			break;
+		case 'l':
+			lflag = 1;
+			break;
+		case 'n':
+			lanes = strtoul(optarg, &end, 10);
+			if (*end != '\0' || lanes < 1 || lanes > ROM_MAX_LANES)
+			{
+				errx(EXIT_FAILURE, "Lane count must be from 1 to %d",
+				     ROM_MAX_LANES);
+			}
+			break;
+		default:
+			hflag = 1;
+			break;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (lflag)
+	{
+		print_license();
+	}
+
+	if (hflag || (!lflag && argc != 1))
+	{
+		print_help();
+	}
+	else
+	{
+		if (argc == 1)
+		{
+			if (romsplit(argv[0], lanes, bank_size, jflag) != 0)
+			{
+				err(errno, jflag ? "Could not join %s" : "Could not split %s",
+				    argv[0]);
+			}
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+
+/* Split `filename' into `filename.0', `filename.1', ...,
+ * or if `join' is set, put them back together into `filename'.
+ */
+int
+romsplit(char const* filename, unsigned lanes, size_t bank_size, int join)
+{
+	struct piece_names names;
+	int fd, status;
+
+	names.filename = filename;
+	names.length = strlen(filename) + 24;
+	names.buffer = malloc(names.length);
+	if (names.buffer == NULL)
+	{
+		return -1;
+	}
+	if (join)
+	{
+		names.flags = O_RDONLY;
+		fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	}
+	else
+	{
+		names.flags = O_RDWR | O_CREAT | O_TRUNC;
+		fd = open(filename, O_RDONLY);
+	}
+	if (fd == -1)
+	{
+		free(names.buffer);
+		return -1;
+	}
+	status = join
+		? rom_join_fd(fd, lanes, bank_size, open_piece, &names)
+		: rom_split_fd(fd, lanes, bank_size, open_piece, &names);
+	if (close(fd) != 0)
+	{
+		status = -1;
+	}
+	free(names.buffer);
+	return status;
+}
+
+
+/* Open piece number `n' of the rom named in `context'.
+ * Missing pieces are left for the join to notice.
+ */
+int
+open_piece(void *context, unsigned long n)
+{
+	struct piece_names *names = context;
+	int fd;
+
+	snprintf(names->buffer, names->length, "%s.%lu", names->filename, n);
+	fd = open(names->buffer, names->flags, 0666);
+	if (fd == -1 && !(errno == ENOENT && names->flags == O_RDONLY))
+	{
+		err(errno, "Could not open file %s", names->buffer);
+	}
+	return fd;
+}
+
+
+/* A size is a number of bytes, optionally followed by k or M.
+ * Returns (size_t)-1 if it is not one.
+ */
+size_t
+parse_size(char const* str)
+{
+	unsigned long size;
+	char *end;
+
+	errno = 0;
+	size = strtoul(str, &end, 0);
+	if (errno != 0 || end == str)
+	{
+		return (size_t)-1;
+	}
+	switch (*end)
+	{
+	case 'k':
+	case 'K':
+		size *= 1024;
+		++end;
+		break;
+	case 'm':
+	case 'M':
+		size *= 1024 * 1024;
+		++end;
+		break;
+	}
+	if (*end != '\0')
+	{
+		return (size_t)-1;
+	}
+	return size;
+}
+
+
+void
+print_help()
+{
+	PERR("romsplit Copyright (c) 2026, Dakotah Lambert.\n");
+	PERR("All rights reserved.\n\n");
+	PERR("usage: romsplit [-h?jl] [-n lanes] [-b bank_size] rom_file\n\n");
+	PERR("  -h, -?       : show this message\n");
+	PERR("  -j           : join rom_file.0, rom_file.1, ... into rom_file\n");
+	PERR("  -l           : display license information\n");
+	PERR("  -n lanes     : number of byte lanes (default 2)\n");
+	PERR("  -b bank_size : bytes per piece, with optional k or M suffix;\n");
+	PERR("                 0 (the default) keeps each lane whole\n");
+	PERR("  rom_file     : BIN / RAW formatted rom to split into\n");
+	PERR("                 rom_file.0, rom_file.1, ...\n\n");
+}
+
+void
+print_license()
+{
+	PERR("\n romsplit\n\
+ Copyright (c) 2026, Dakotah Lambert\n\
+ All rights reserved.\n\
+\n\
+ Redistribution and use in source and binary forms, with or without\n\
+ modification, are permitted provided that the following conditions\n\
+ are met:\n\
+\n\
+ 1: Redistributions of source code must retain the above copyright\n\
+    notice, this list of conditions and the following disclaimer.\n\
+\n\
+ 2: Redistributions in binary form must reproduce the above copyright\n\
+    notice, this list of conditions and the following disclaimer in\n\
+    the documentation and/or other materials provided with the\n\
+    distribution.\n\
+\n\
+ 3: Neither the names of copyright holders nor the names of their\n\
+    contributors may be used to endors or promote products derived\n\
+    from this software without specific prior written permission.\n\
+\n\
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS\n\
+  \"AS IS\" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT\n\
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS\n\
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED, IN NO EVENT SHALL THE\n\
+  COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,\n\
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,\n\
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;\n\
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER\n\
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT\n\
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN\n\
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE\n\
+  POSSIBILITY OF SUCH DAMAGE.\n\n");
+}
@@ -16,11 +16,24 @@
 #include <string.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+
+#include "split.h"
+#include "stats.h"
 
 #define kB * 1024
+#define BANK_SIZE (128 kB)
 #define PERR(str) fprintf(stderr, str)
 
+struct bank_names
+{
+	char const *filename;
+	char *buffer;
+	size_t length;
+};
+
 void s128k(char*);
+int open_bank(void*, unsigned long);
 void print_help();
 void print_license();
 
@@ -28,6 +41,7 @@ int
 main(int argc, char* argv[])
 {
 	int ch = 0, hflag = 0, lflag = 0;
+	rom_stats_start(argv[0]);
 	while ( (ch = getopt(argc, argv, "h?l")) != -1 )
 	{
 		switch (ch)
@@ -47,7 +61,7 @@ main(int argc, char* argv[])
 	argc -= optind;
 	argv += optind;
 
-	
+	
 	if (lflag)
 	{
 		print_license();
@@ -67,61 +81,57 @@ main(int argc, char* argv[])
 	return EXIT_SUCCESS;
 }
 
-
+
+/* Each 256 kB window of the input is split into a 128 kB file of its
+ * even bytes and a 128 kB file of its odd bytes, numbered in order.
+ * This is the two-lane, 128 kB bank case of the split engine.
+ */
 void
 s128k(char* filename)
 {
-	ssize_t cpos = 0, length = strlen(filename) + 4;
-	char next_even, next_odd;
-	char name_buffer[length];
-	FILE *ifile = NULL, *odd_file = NULL, *even_file = NULL;
-	
-	ifile = fopen(filename, "rb");
-	if (ifile == NULL)
+	struct bank_names names;
+	int ifile;
+
+	names.filename = filename;
+	names.length = strlen(filename) + 24;
+	names.buffer = malloc(names.length);
+	if (names.buffer == NULL)
+	{
+		err(errno, "Could not allocate memory");
+	}
+	ifile = open(filename, O_RDONLY);
+	if (ifile == -1)
 	{
 		err(errno, "Could not open file %s", filename);
-		exit(EXIT_FAILURE);
 	}
-	
-	next_even = fgetc(ifile);
-	next_odd = fgetc(ifile);
-	while (!feof(ifile) && !ferror(ifile)
-	       && (odd_file == NULL || !ferror(odd_file))
-	       && (even_file == NULL || !ferror(even_file)))
+	if (rom_split_fd(ifile, 2, BANK_SIZE, open_bank, &names) != 0)
 	{
-		if (cpos % (128 kB) == 0)
-		{
-			if (odd_file != NULL) fclose(odd_file);
-			if (even_file != NULL) fclose(even_file);
-			snprintf(name_buffer, length, "%s.%ld",
-			         filename, (long)(2*cpos/(128 kB)));
-			even_file = fopen(name_buffer, "wb");
-			if (even_file == NULL)
-			{
-				fclose(ifile);
-				exit(EXIT_FAILURE);
-			}
-			
-			snprintf(name_buffer, length, "%s.%ld",
-			         filename, (long)(2*cpos/(128 kB) + 1));
-			odd_file = fopen(name_buffer, "wb");
-			if (odd_file == NULL)
-			{
-				fclose(ifile);
-				fclose(even_file);
-				exit(EXIT_FAILURE);
-			}
-		}
-		
-		fputc(next_odd, odd_file);
-		next_even = fgetc(ifile);
-		fputc(next_even, even_file);
-		next_odd = fgetc(ifile);
-		++cpos;
+		err(errno, "Could not split %s", filename);
+	}
+	close(ifile);
+	free(names.buffer);
+}
+
+
+/* Create output file number `n' for the rom named in `context',
+ * readable as well so that it can be mapped.
+ */
+int
+open_bank(void *context, unsigned long n)
+{
+	struct bank_names *names = context;
+	int fd;
+
+	snprintf(names->buffer, names->length, "%s.%lu", names->filename, n);
+	fd = open(names->buffer, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+	{
+		err(errno, "Could not open file %s", names->buffer);
 	}
+	return fd;
 }
 
-
+
 void
 print_help()
 {
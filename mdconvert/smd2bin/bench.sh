@@ -0,0 +1,39 @@
+#!/bin/sh
+# bench.sh: measure smd2bin throughput, optionally against another build
+# usage: bench.sh [smd2bin] [reference_smd2bin] [megabits]
+#
+# A random SMD image of the given size (default 64 Mbit) is made by
+# mdbench (see ../../bench, or set MDBENCH) and converted by each
+# program, and the best of five runs is reported.  If a reference
+# program is given (by default, any smd2bin found in PATH), its output
+# is also checked to be identical.
+
+SMD2BIN=${1:-./smd2bin}
+REFERENCE=${2:-$(command -v smd2bin)}
+MBITS=${3:-64}
+MDBENCH=${MDBENCH:-$(dirname "$0")/../../bench/mdbench}
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/smd2bin-bench.XXXXXX") || exit 1
+trap 'rm -rf "${WORK}"' EXIT INT TERM
+
+"${MDBENCH}" gen -f smd "${MBITS}" "${WORK}/in.smd" || exit 1
+SIZE=$(wc -c <"${WORK}/in.smd" | tr -d ' ')
+
+# time one program; print the best time in seconds
+best_of() {
+	set -- $("${MDBENCH}" run -n 5 "$1" -o "$2" "${WORK}/in.smd") || exit 1
+	[ $# -eq 2 ] || exit 1
+	echo "$1"
+}
+
+report() {
+	echo "$1 $2 ${SIZE}" \
+	| awk '{ printf "%-40s %10.4f %10.1f\n", $1, $2, $3 / $2 / 1e6 }'
+}
+
+printf '%-40s %10s %10s\n' program seconds 'MB/s'
+report "${SMD2BIN}" "$(best_of "${SMD2BIN}" "${WORK}/out.bin")"
+if [ -n "${REFERENCE}" ]; then
+	report "${REFERENCE}" "$(best_of "${REFERENCE}" "${WORK}/ref.bin")"
+	cmp -s "${WORK}/out.bin" "${WORK}/ref.bin" \
+	|| echo "warning: output differs from ${REFERENCE}"
+fi
@@ -8,11 +8,16 @@
 #include <string.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 
-#define HEADER_SIZE 0x200
+#include "rombuf.h"
+#include "smd.h"
+#include "stats.h"
+
+#define BLOCKS_PER_READ 16
 #define PERR(str) fprintf(stderr, str)
 
-void smd2bin(FILE*, FILE*);
+int smd2bin(int, int);
 void print_help();
 void print_license();
 
@@ -21,6 +26,7 @@ main(int argc, char* argv[])
 {
 	int ch = 0, hflag = 0, lflag = 0, oflag = 0;
 	char output_filename[256];
+	rom_stats_start(argv[0]);
 	while ( (ch = getopt(argc, argv, "h?lo:")) != -1 )
 	{
 		switch (ch)
@@ -59,74 +65,115 @@ main(int argc, char* argv[])
 	{
 		if (argc == 1 && oflag)
 		{
-			FILE *istream, *ostream;
-			istream =	fopen(argv[0], "rb");
-			if (istream == NULL)
+			int ifile, ofile;
+			ifile = (strcmp(argv[0], "-") == 0)
+				? STDIN_FILENO : open(argv[0], O_RDONLY);
+			if (ifile == -1)
 			{
 				err(errno, "Could not open file %s", argv[0]);
 				return EXIT_FAILURE;
 			}
 
-			ostream = fopen(output_filename, "wb");
-			if (ostream == NULL)
+			ofile = (strcmp(output_filename, "-") == 0)
+				? STDOUT_FILENO
+				: open(output_filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+			if (ofile == -1)
 			{
 				err(errno, "Could not open file %s", output_filename);
-				fclose(istream);
+				close(ifile);
 				return EXIT_FAILURE;
 			}
 
-			smd2bin(istream, ostream);
-			fclose(istream);
-			fclose(ostream);
+			if (smd2bin(ifile, ofile) != 0 || close(ofile) != 0)
+			{
+				err(errno, "Could not write %s", output_filename);
+			}
+			close(ifile);
 		}
 	}
 	return EXIT_SUCCESS;
 }
 
 
-void
-smd2bin(FILE *istream, FILE *ostream)
+/* The header of the SMD file is skipped, and its blocks (see smd.h)
+ * are interleaved straight from the input to the output in one forward
+ * pass, so either may be a pipe.  A regular file is mapped and
+ * handled several blocks at a time, and if the size of the input is
+ * known, the output is given its full size and mapped as well;
+ * a pipe is read one block at a time.
+ * Returns 0, or -1 with errno set.
+ */
+int
+smd2bin(int ifile, int ofile)
 {
-	ssize_t cpos = 0;
-	char next_char;
-	
-	fseek(istream, HEADER_SIZE, SEEK_SET);
-	fseek(ostream, 0, SEEK_SET);
-	next_char = fgetc(istream);
-	while (!( feof(istream) ) && !( ferror(istream) )
-	       && !( ferror(ostream) ))
+	struct rom_input in;
+	struct rom_output out;
+	unsigned char const *data;
+	unsigned char *dest;
+	size_t read_size = ROM_SMD_BLOCK_SIZE;
+	size_t nread;
+	off_t remaining;
+	int status = -1;
+	int saved;
+
+	rom_input_open(&in, ifile);
+	if (rom_input_read(&in, &data, ROM_SMD_HEADER_SIZE) < ROM_SMD_HEADER_SIZE)
+	{
+		/* not even a header, so nothing to convert */
+		rom_input_close(&in);
+		return 0;
+	}
+	remaining = rom_input_remaining(&in);
+	if (remaining >= 0)
+	{
+		read_size = BLOCKS_PER_READ * ROM_SMD_BLOCK_SIZE;
+	}
+	if (rom_output_open(&out, ofile, -1,
+	                    (remaining < 0) ? -1 : (off_t)rom_bin_size(remaining))
+	    != 0)
+	{
+		rom_input_close(&in);
+		return -1;
+	}
+	/* on a pipe, hold no more than the block in hand */
+	rom_output_buffer(&out, ROM_SMD_BLOCK_SIZE);
+	for (;;)
 	{
-		fputc('\0', ostream);
-		fputc(next_char, ostream);
-		++cpos;
-		if ((cpos / 8192) % 2 == 1)
+		nread = rom_input_read(&in, &data, read_size);
+		if (nread == (size_t)-1)
 		{
-			cpos += 8192;
-			fseek(istream, 8192, SEEK_CUR);
+			goto done;
+		}
+		if (nread == 0)
+		{
+			break;
+		}
+		dest = rom_output_next(&out, rom_bin_size(nread));
+		if (dest == NULL)
+		{
+			goto done;
+		}
+		rom_smd_decode(dest, data, nread);
+		if (nread < read_size)
+		{
+			break;
 		}
-		next_char = fgetc(istream);
 	}
+	status = 0;
 
-	cpos = 8192;
-	fseek(istream, HEADER_SIZE + 8192, SEEK_SET);
-	fseek(ostream, 0, SEEK_SET);
-	next_char = fgetc(istream);
-	while (!( feof(istream) ) && !( ferror(istream) )
-	       && !( ferror(ostream) ))
+done:
+	saved = errno;
+	if (rom_output_close(&out) != 0 && status == 0)
 	{
-		fputc(next_char, ostream);
-		fseek(ostream, 1, SEEK_CUR);
-		++cpos;
-		if ((cpos / 8192) % 2 == 0)
-		{
-			cpos += 8192;
-			fseek(istream, 8192, SEEK_CUR);
-		}
-		next_char = fgetc(istream);
+		saved = errno;
+		status = -1;
 	}
+	rom_input_close(&in);
+	errno = saved;
+	return status;
 }
 
-
+
 void
 print_help()
 {
@@ -135,8 +182,9 @@ print_help()
 	PERR("usage: smd2bin [-h?l] -o outfile infile\n\n");
 	PERR("  -h, -? : show this message\n");
 	PERR("  -l     : display license information\n");
-	PERR("  -o     : mandatory; followed by name of output file\n");
-	PERR("  infile : name of file to convert\n\n");
+	PERR("  -o     : mandatory; followed by name of output file,\n");
+	PERR("           or - for standard output\n");
+	PERR("  infile : name of file to convert, or - for standard input\n\n");
 }
 
 void